@@ -0,0 +1,683 @@
+#include "BVH.h"
+#include "GameObject.h"
+#include "Component.h"
+#include "ComponentCamera.h"
+#include <algorithm>
+#include <chrono>
+
+BVH::BVH() {}
+
+BVH::~BVH()
+{
+	Clear();
+}
+
+// ----------------------------------------------------------------- [Objects]
+void BVH::Insert(GameObject* obj)
+{
+	InsertRecursive(obj);
+
+	// a whole scene or model: do not wait for the background
+	if (nodes.empty() || pending.size() > BVH_MAX_PENDING)
+		Rebuild();
+}
+
+// Pending, then one rebuild at most for the lot
+void BVH::InsertBatch(const std::vector<GameObject*>& objs)
+{
+	for (auto& obj : objs)
+		InsertRecursive(obj);
+
+	if (nodes.empty() || pending.size() > BVH_MAX_PENDING)
+		Rebuild();
+}
+
+void BVH::InsertRecursive(GameObject* obj)
+{
+	if (obj->spatialHandle == SPATIAL_NONE)
+	{
+		AddPending(AcquireHandle(obj));
+		changed = true;
+	}
+
+	auto children = obj->GetImmidiateChildren();
+	for (auto& child : children)
+		InsertRecursive(child);
+}
+
+void BVH::Remove(GameObject* obj)
+{
+	uint handle = obj->spatialHandle;
+	if (handle == SPATIAL_NONE)
+		return;
+
+	uint leaf = objectLeaves[handle];
+	if (leaf != SPATIAL_NONE)
+	{
+		// swap with the last one in the leaf's range
+		BVHNode& node = nodes[leaf];
+		for (uint i = node.objFirst; i < node.objFirst + node.objCount; ++i)
+		{
+			if (objectRefs[i] == handle)
+			{
+				objectRefs[i] = objectRefs[node.objFirst + node.objCount - 1];
+				node.objCount--;
+				break;
+			}
+		}
+		Refit(leaf);
+	}
+	else
+		RemovePending(handle);
+
+	ReleaseHandle(handle);
+	changed = true;
+}
+
+// The tree stays the same, only the boxes above the object's leaf change
+void BVH::OnObjectMoved(GameObject* obj)
+{
+	uint handle = obj->spatialHandle;
+	if (handle == SPATIAL_NONE || objectLeaves[handle] == SPATIAL_NONE)
+		return;
+
+	Refit(objectLeaves[handle]);
+	changed = true;
+}
+
+void BVH::Refit(uint node)
+{
+	while (node != SPATIAL_NONE)
+	{
+		math::AABB box;
+		box.SetNegativeInfinity();
+
+		const BVHNode& n = nodes[node];
+		if (n.IsLeaf())
+			for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+				box.Enclose(objects[objectRefs[i]]->GetBoundingData().AABB);
+		else
+		{
+			box.Enclose(nodes[n.firstChild].box);
+			box.Enclose(nodes[n.firstChild + 1].box);
+		}
+
+		// nothing changes from here up
+		if (box.minPoint.Equals(n.box.minPoint, 0.f) && box.maxPoint.Equals(n.box.maxPoint, 0.f))
+			return;
+
+		nodes[node].box = box;
+		node = n.parent;
+	}
+}
+
+void BVH::Clear()
+{
+	if (rebuild.valid())
+		rebuild.wait();
+	rebuild = std::future<void>();
+	rebuildData.reset();
+
+	for (auto& obj : objects)
+		if (obj)
+			obj->spatialHandle = SPATIAL_NONE;
+
+	nodes.clear();
+	objectRefs.clear();
+	objects.clear();
+	objectLeaves.clear();
+	generations.clear();
+	freeHandles.clear();
+	pending.clear();
+	pendingSlots.clear();
+	changed = false;
+	rebuildTimer = 0.f;
+}
+
+void BVH::Update(float dt)
+{
+	// A) a background build is done: take it
+	if (rebuild.valid())
+	{
+		if (rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			rebuild.get();
+			AdoptBuild(*rebuildData);
+			rebuildData.reset();
+		}
+		return;
+	}
+
+	// B) now and then, if there were changes, start one
+	rebuildTimer += dt;
+	if (rebuildTimer >= BVH_REBUILD_INTERVAL && changed)
+	{
+		rebuildTimer = 0.f;
+		StartBackgroundRebuild();
+	}
+}
+
+// ----------------------------------------------------------------- [Queries]
+void BVH::CollectCandidates(std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects) const
+{
+	SpatialQueryCounters counters;
+	uint first = gameObjects.size();
+	if (nodes.empty() == false)
+		CollectNodeCandidates(0, gameObjects, query, testObjects, counters);
+
+	for (auto& handle : pending)
+	{
+		GameObject* obj = objects[handle];
+		counters.objectTests++;
+		if (query.Intersects(obj->GetBoundingData().AABB) && (testObjects == false || query.Intersects(obj->GetBoundingData().OBB)))
+			gameObjects.push_back(obj);
+	}
+
+	counters.candidates = gameObjects.size() - first;
+	RecordQuery(SPATIAL_QUERY::CANDIDATES, counters);
+}
+
+void BVH::CollectNodeCandidates(uint node, std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects, SpatialQueryCounters& counters) const
+{
+	const BVHNode& n = nodes[node];
+	if (n.box.IsFinite() == false) // empty
+		return;
+	counters.aabbTests++;
+	if (query.Intersects(n.box) == false)
+		return;
+
+	counters.nodesVisited++;
+	if (n.IsLeaf())
+	{
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+		{
+			GameObject* obj = objects[objectRefs[i]];
+			counters.objectTests += testObjects;
+			if (testObjects == false || query.Intersects(obj->GetBoundingData().OBB))
+				gameObjects.push_back(obj);
+		}
+		return;
+	}
+
+	CollectNodeCandidates(n.firstChild, gameObjects, query, testObjects, counters);
+	CollectNodeCandidates(n.firstChild + 1, gameObjects, query, testObjects, counters);
+}
+
+void BVH::CollectFrustrumCandidates(std::vector<GameObject*>& gameObjects, const Frustrum& frustrum) const
+{
+	SpatialQueryCounters counters;
+	uint first = gameObjects.size();
+	if (nodes.empty() == false)
+		CollectNodeFrustrum(0, gameObjects, frustrum, FRUSTRUM_ALL_PLANES, counters);
+
+	for (auto& handle : pending)
+	{
+		GameObject* obj = objects[handle];
+		counters.objectTests++;
+		if (frustrum.ClassifyOBB(obj->GetBoundingData().OBB, FRUSTRUM_ALL_PLANES) != Frustrum::INTERSECTION_TYPE::OUTSIDE)
+			gameObjects.push_back(obj);
+	}
+
+	counters.candidates = gameObjects.size() - first;
+	RecordQuery(SPATIAL_QUERY::FRUSTRUM, counters);
+}
+
+void BVH::CollectNodeFrustrum(uint node, std::vector<GameObject*>& gameObjects, const Frustrum& frustrum, uint planeMask, SpatialQueryCounters& counters) const
+{
+	const BVHNode& n = nodes[node];
+	if (n.box.IsFinite() == false) // empty
+		return;
+
+	// node boxes enclose their objects: fully inside means all of them are visible
+	counters.aabbTests++;
+	Frustrum::INTERSECTION_TYPE type = frustrum.ClassifyAABB(n.box.CenterPoint(), n.box.HalfSize(), planeMask);
+	if (type == Frustrum::INTERSECTION_TYPE::OUTSIDE)
+		return;
+	if (type == Frustrum::INTERSECTION_TYPE::INSIDE)
+	{
+		CollectSubtree(node, gameObjects, counters);
+		return;
+	}
+
+	counters.nodesVisited++;
+	if (n.IsLeaf())
+	{
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+		{
+			GameObject* obj = objects[objectRefs[i]];
+			counters.objectTests++;
+			if (frustrum.ClassifyOBB(obj->GetBoundingData().OBB, planeMask) != Frustrum::INTERSECTION_TYPE::OUTSIDE)
+				gameObjects.push_back(obj);
+		}
+		return;
+	}
+
+	CollectNodeFrustrum(n.firstChild, gameObjects, frustrum, planeMask, counters);
+	CollectNodeFrustrum(n.firstChild + 1, gameObjects, frustrum, planeMask, counters);
+}
+
+void BVH::CollectSubtree(uint node, std::vector<GameObject*>& gameObjects, SpatialQueryCounters& counters) const
+{
+	counters.nodesVisited++;
+	const BVHNode& n = nodes[node];
+	if (n.IsLeaf())
+	{
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+			gameObjects.push_back(objects[objectRefs[i]]);
+		return;
+	}
+
+	CollectSubtree(n.firstChild, gameObjects, counters);
+	CollectSubtree(n.firstChild + 1, gameObjects, counters);
+}
+
+// Node boxes enclose their objects, so a node is never further than anything below it. Pending objects go straight
+// to the queue
+SpatialHit BVH::Raycast(const math::LineSegment& ray, const SpatialRayTest& test) const
+{
+	SpatialHit closest;
+	SpatialQueryCounters counters;
+	SpatialQueue queue;
+	float dNear = 0.f, dFar = 0.f;
+
+	if (nodes.empty() == false && nodes[0].box.IsFinite() && nodes[0].box.Intersects(ray, dNear, dFar))
+		queue.push({ dNear, 0, false });
+	for (auto& handle : pending)
+	{
+		counters.objectTests++;
+		if (objects[handle]->GetBoundingData().OBB.Intersects(ray, dNear, dFar))
+			queue.push({ dNear, handle, true });
+	}
+
+	while (queue.empty() == false && queue.top().distance < closest.distance)
+	{
+		SpatialQueueEntry entry = queue.top();
+		queue.pop();
+
+		if (entry.isObject)
+		{
+			counters.candidates++;
+			if (test(objects[entry.index], dNear) && dNear < closest.distance)
+				closest = { objects[entry.index], dNear };
+			continue;
+		}
+
+		counters.nodesVisited++;
+		const BVHNode& n = nodes[entry.index];
+		if (n.IsLeaf())
+		{
+			for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+			{
+				counters.objectTests++;
+				if (objects[objectRefs[i]]->GetBoundingData().OBB.Intersects(ray, dNear, dFar))
+					queue.push({ dNear, objectRefs[i], true });
+			}
+			continue; 
+		}
+
+		for (uint child = n.firstChild; child < n.firstChild + 2; ++child)
+		{
+			if (nodes[child].box.IsFinite() == false)
+				continue;
+			counters.aabbTests++;
+			if (nodes[child].box.Intersects(ray, dNear, dFar))
+				queue.push({ dNear, child, false });
+		}
+	}
+
+	RecordQuery(SPATIAL_QUERY::RAYCAST, counters);
+	return closest;
+}
+
+void BVH::CollectNearest(std::vector<SpatialHit>& hits, const float3& point, uint count, float maxDistance) const
+{
+	SpatialQueryCounters counters;
+	SpatialQueue queue;
+	if (nodes.empty() == false && nodes[0].box.IsFinite() && nodes[0].box.Distance(point) <= maxDistance)
+		queue.push({ nodes[0].box.Distance(point), 0, false });
+	for (auto& handle : pending)
+	{
+		counters.objectTests++;
+		float distance = objects[handle]->GetBoundingData().OBB.Distance(point);
+		if (distance <= maxDistance)
+			queue.push({ distance, handle, true });
+	}
+
+	while (queue.empty() == false && counters.candidates < count)
+	{
+		SpatialQueueEntry entry = queue.top();
+		queue.pop();
+
+		if (entry.isObject)
+		{
+			hits.push_back({ objects[entry.index], entry.distance });
+			counters.candidates++;
+			continue;
+		}
+
+		counters.nodesVisited++;
+		const BVHNode& n = nodes[entry.index];
+		if (n.IsLeaf())
+		{
+			for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+			{
+				counters.objectTests++;
+				float distance = objects[objectRefs[i]]->GetBoundingData().OBB.Distance(point);
+				if (distance <= maxDistance)
+					queue.push({ distance, objectRefs[i], true });
+			}
+			continue;
+		}
+
+		for (uint child = n.firstChild; child < n.firstChild + 2; ++child)
+		{
+			if (nodes[child].box.IsFinite() == false)
+				continue; 
+			counters.aabbTests++;
+			float distance = nodes[child].box.Distance(point);
+			if (distance <= maxDistance)
+				queue.push({ distance, child, false });
+		}
+	}
+
+	RecordQuery(SPATIAL_QUERY::NEAREST, counters);
+}
+
+// ----------------------------------------------------------------- [Building]
+void BVH::Rebuild()
+{
+	// an older background build would be stale
+	if (rebuild.valid())
+		rebuild.wait();
+	rebuild = std::future<void>();
+	rebuildData.reset();
+
+	BVHBuildData data;
+	CopyBuildData(data);
+	changed = false;
+	Build(data);
+	AdoptBuild(data);
+}
+
+void BVH::StartBackgroundRebuild()
+{
+	rebuildData = std::make_unique<BVHBuildData>();
+	CopyBuildData(*rebuildData);
+	changed = false;
+
+	BVHBuildData* data = rebuildData.get();
+	rebuild = std::async(std::launch::async, [data]() { Build(*data); });
+}
+
+void BVH::CopyBuildData(BVHBuildData& data) const
+{
+	for (uint handle = 0; handle < objects.size(); ++handle)
+	{
+		if (objects[handle] == nullptr)
+			continue;
+
+		data.boxes.push_back(objects[handle]->GetBoundingData().AABB);
+		data.handles.push_back(handle);
+		data.generations.push_back(generations[handle]);
+	}
+}
+
+void BVH::Build(BVHBuildData& data)
+{
+	data.nodes.clear();
+	data.objectRefs.clear();
+	if (data.boxes.empty())
+		return;
+
+	std::vector<uint> order(data.boxes.size());
+	for (uint i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	data.nodes.push_back(BVHNode());
+	BuildNode(data, order, 0, 0, order.size());
+}
+
+// Binned SAH: the centroids are spread in bins along the widest axis, and the split between bins that minimizes
+// (left area * left count + right area * right count) wins
+void BVH::BuildNode(BVHBuildData& data, std::vector<uint>& order, uint node, uint first, uint count)
+{
+	math::AABB box, centroidBox;
+	box.SetNegativeInfinity();
+	centroidBox.SetNegativeInfinity();
+	for (uint i = first; i < first + count; ++i)
+	{
+		box.Enclose(data.boxes[order[i]]);
+		centroidBox.Enclose(data.boxes[order[i]].CenterPoint());
+	}
+	data.nodes[node].box = box;
+
+	// Widest centroid axis
+	float3 extent = centroidBox.Size();
+	int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+
+	// A) Leaf
+	if (count <= BVH_MAX_LEAF_OBJECTS || extent[axis] <= 0.f)
+	{
+		data.nodes[node].objFirst = data.objectRefs.size();
+		data.nodes[node].objCount = count;
+		for (uint i = first; i < first + count; ++i)
+			data.objectRefs.push_back(data.handles[order[i]]);
+		return;
+	}
+
+	// B) Bin the centroids
+	math::AABB binBoxes[BVH_SAH_BINS];
+	uint binCounts[BVH_SAH_BINS] = { 0 };
+	for (auto& binBox : binBoxes)
+		binBox.SetNegativeInfinity();
+
+	float binScale = BVH_SAH_BINS / extent[axis];
+	auto GetBin = [&](uint object) -> uint
+	{
+		uint bin = (uint)((data.boxes[object].CenterPoint()[axis] - centroidBox.minPoint[axis]) * binScale);
+		return (bin < BVH_SAH_BINS) ? bin : BVH_SAH_BINS - 1;
+	};
+	for (uint i = first; i < first + count; ++i)
+	{
+		uint bin = GetBin(order[i]);
+		binCounts[bin]++;
+		binBoxes[bin].Enclose(data.boxes[order[i]]);
+	}
+
+	// C) Sweep from the right, then from the left, to cost every split
+	float rightAreas[BVH_SAH_BINS];
+	uint rightCounts[BVH_SAH_BINS];
+	math::AABB sweep;
+	sweep.SetNegativeInfinity();
+	uint sweepCount = 0;
+	for (int i = BVH_SAH_BINS - 1; i > 0; --i)
+	{
+		sweep.Enclose(binBoxes[i]);
+		sweepCount += binCounts[i];
+		rightAreas[i] = (sweepCount > 0) ? sweep.SurfaceArea() : 0.f;
+		rightCounts[i] = sweepCount;
+	}
+
+	uint bestSplit = 0;
+	float bestCost = FLT_MAX;
+	sweep.SetNegativeInfinity();
+	sweepCount = 0;
+	for (uint i = 1; i < BVH_SAH_BINS; ++i)
+	{
+		sweep.Enclose(binBoxes[i - 1]);
+		sweepCount += binCounts[i - 1];
+		if (sweepCount == 0 || rightCounts[i] == 0)
+			continue;
+
+		float cost = sweep.SurfaceArea() * sweepCount + rightAreas[i] * rightCounts[i];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestSplit = i;
+		}
+	}
+
+	// D) Partition (no split found: halve it by the centroids)
+	uint leftCount = 0;
+	if (bestSplit > 0)
+		leftCount = std::partition(order.begin() + first, order.begin() + first + count,
+			[&](uint object) { return GetBin(object) < bestSplit; }) - (order.begin() + first);
+	if (leftCount == 0 || leftCount == count)
+	{
+		leftCount = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + leftCount, order.begin() + first + count,
+			[&](uint a, uint b) { return data.boxes[a].CenterPoint()[axis] < data.boxes[b].CenterPoint()[axis]; });
+	}
+
+	// E) Children, side by side
+	uint firstChild = data.nodes.size();
+	data.nodes.push_back(BVHNode());
+	data.nodes.push_back(BVHNode());
+	data.nodes[node].firstChild = firstChild;
+	data.nodes[firstChild].parent = data.nodes[firstChild + 1].parent = node;
+
+	BuildNode(data, order, firstChild, first, leftCount);
+	BuildNode(data, order, firstChild + 1, first + leftCount, count - leftCount);
+}
+
+// The build may be older than the current objects: drop the ones removed since, keep waiting the ones added since,
+// and refit all boxes to where the objects are now
+void BVH::AdoptBuild(BVHBuildData& data)
+{
+	nodes.swap(data.nodes);
+	objectRefs.swap(data.objectRefs);
+
+	std::vector<bool> stale(objects.size(), false);
+	for (uint i = 0; i < data.handles.size(); ++i)
+		stale[data.handles[i]] = (generations[data.handles[i]] != data.generations[i]);
+
+	std::fill(objectLeaves.begin(), objectLeaves.end(), SPATIAL_NONE);
+	for (uint node = 0; node < nodes.size(); ++node)
+	{
+		BVHNode& n = nodes[node];
+		if (n.IsLeaf() == false)
+			continue;
+
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount;)
+		{
+			uint handle = objectRefs[i];
+			if (stale[handle])
+				objectRefs[i] = objectRefs[n.objFirst + --n.objCount];
+			else
+			{
+				objectLeaves[handle] = node;
+				++i;
+			}
+		}
+	}
+
+	for (uint i = 0; i < pending.size();)
+	{
+		if (objectLeaves[pending[i]] != SPATIAL_NONE)
+			RemovePending(pending[i]);
+		else
+			++i;
+	}
+
+	// children always come after their parent: refit backwards
+	for (int node = (int)nodes.size() - 1; node >= 0; --node)
+	{
+		BVHNode& n = nodes[node];
+		n.box.SetNegativeInfinity();
+		if (n.IsLeaf())
+			for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+				n.box.Enclose(objects[objectRefs[i]]->GetBoundingData().AABB);
+		else
+		{
+			n.box.Enclose(nodes[n.firstChild].box);
+			n.box.Enclose(nodes[n.firstChild + 1].box);
+		}
+	}
+}
+
+// ----------------------------------------------------------------- [Pending objects]
+void BVH::AddPending(uint handle)
+{
+	pendingSlots[handle] = pending.size();
+	pending.push_back(handle);
+}
+
+void BVH::RemovePending(uint handle)
+{
+	uint slot = pendingSlots[handle];
+	if (slot == SPATIAL_NONE)
+		return;
+
+	pending[slot] = pending.back();
+	pendingSlots[pending[slot]] = slot;
+	pending.pop_back();
+	pendingSlots[handle] = SPATIAL_NONE;
+}
+
+// ----------------------------------------------------------------- [Object handles]
+uint BVH::AcquireHandle(GameObject* obj)
+{
+	uint handle = 0;
+	if (freeHandles.empty() == false)
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		objects[handle] = obj;
+	}
+	else
+	{
+		handle = objects.size();
+		objects.push_back(obj);
+		objectLeaves.push_back(SPATIAL_NONE);
+		pendingSlots.push_back(SPATIAL_NONE);
+		generations.push_back(0);
+	}
+
+	return obj->spatialHandle = handle;
+}
+
+void BVH::ReleaseHandle(uint handle)
+{
+	objects[handle]->spatialHandle = SPATIAL_NONE;
+	objects[handle] = nullptr;
+	objectLeaves[handle] = SPATIAL_NONE;
+	generations[handle]++;
+	freeHandles.push_back(handle);
+}
+
+// ----------------------------------------------------------------- [Debug]
+void BVH::Debug() const
+{
+	for (auto& node : nodes)
+		if (node.box.IsFinite())
+			DebugAABB(node.box);
+}
+
+uint BVH::GetInsideCount() const
+{
+	uint ret = pending.size();
+	for (auto& node : nodes)
+		if (node.IsLeaf())
+			ret += node.objCount;
+
+	return ret;
+}
+
+void BVH::GetTreeStats(SpatialStats& stats) const
+{
+	if (nodes.empty() == false)
+		AddNodeStats(stats, 0, 0);
+	stats.referenceCount += pending.size(); // not in a node yet
+	stats.Finish(objects.size() - freeHandles.size());
+}
+
+void BVH::AddNodeStats(SpatialStats& stats, uint node, uint depth) const
+{
+	const BVHNode& n = nodes[node];
+	stats.AddNode(depth, n.objCount, n.IsLeaf());
+	if (n.IsLeaf() == false)
+	{
+		AddNodeStats(stats, n.firstChild, depth + 1);
+		AddNodeStats(stats, n.firstChild + 1, depth + 1);
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "SpatialIndex.h"
+#include <future>
+#include <memory>
+
+#define BVH_MAX_LEAF_OBJECTS 4
+#define BVH_SAH_BINS 12
+#define BVH_REBUILD_INTERVAL 2.f // seconds between background rebuilds, if the tree changed
+#define BVH_MAX_PENDING 64 // with more objects than this waiting, the tree is rebuilt on the spot
+
+// ----------------------------------------------------------------- [BVHNode]
+// Nodes live in one array. The two children of a node are stored together (firstChild, firstChild + 1).
+// A leaf keeps a range of the shared object array instead
+struct BVHNode
+{
+	math::AABB box;
+	uint parent = SPATIAL_NONE;
+	uint firstChild = SPATIAL_NONE;
+	uint objFirst = 0, objCount = 0;
+
+	inline bool IsLeaf() const { return firstChild == SPATIAL_NONE; };
+};
+
+// What a build needs: a copy of the objects' boxes, so it can run on another thread
+struct BVHBuildData
+{
+	std::vector<math::AABB> boxes;
+	std::vector<uint> handles;
+	std::vector<uint> generations; // of each handle when copied, to spot the ones removed (or reused) meanwhile
+
+	std::vector<BVHNode> nodes; // the result
+	std::vector<uint> objectRefs;
+};
+
+// ----------------------------------------------------------------- [BVH]
+// Bounding volume hierarchy built top-down with the surface area heuristic (binned). It keeps static and non-static
+// objects: a moved object refits the boxes above its leaf, and the tree is rebuilt in the background now and then,
+// as refits make it worse. Objects inserted after a build wait in a pending list (tested one by one) until the next
+class BVH : public SpatialIndex
+{
+public:
+	BVH();
+	~BVH();
+
+	void Insert(GameObject* obj);
+	void InsertBatch(const std::vector<GameObject*>& objs);
+	void Remove(GameObject* obj);
+	void OnObjectMoved(GameObject* obj);
+	void Clear();
+	void Update(float dt);
+
+	void CollectCandidates(std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects) const;
+	void CollectFrustrumCandidates(std::vector<GameObject*>& gameObjects, const Frustrum& frustrum) const;
+	SpatialHit Raycast(const math::LineSegment& ray, const SpatialRayTest& test) const;
+	void CollectNearest(std::vector<SpatialHit>& hits, const float3& point, uint count, float maxDistance) const;
+
+	SPATIAL_BACKEND GetType() const { return SPATIAL_BACKEND::BVH; };
+	bool IndexesDynamicObjects() const { return true; };
+	uint GetNodeCount() const { return nodes.size(); };
+	uint GetInsideCount() const;
+	void Debug() const;
+
+	// BVH only
+	void Rebuild(); // right now, on this thread
+	uint GetPendingCount() const { return pending.size(); };
+	bool IsRebuilding() const { return rebuild.valid(); };
+
+protected:
+	void GetTreeStats(SpatialStats& stats) const;
+
+private:
+	void InsertRecursive(GameObject* obj);
+	void CollectNodeCandidates(uint node, std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects, SpatialQueryCounters& counters) const;
+	void CollectNodeFrustrum(uint node, std::vector<GameObject*>& gameObjects, const Frustrum& frustrum, uint planeMask, SpatialQueryCounters& counters) const;
+	void CollectSubtree(uint node, std::vector<GameObject*>& gameObjects, SpatialQueryCounters& counters) const;
+	void AddNodeStats(SpatialStats& stats, uint node, uint depth) const;
+	void Refit(uint node); // the node and all above it
+
+	// Building (no access to the scene: works only with the build data)
+	static void Build(BVHBuildData& data);
+	static void BuildNode(BVHBuildData& data, std::vector<uint>& order, uint node, uint first, uint count);
+	void CopyBuildData(BVHBuildData& data) const;
+	void AdoptBuild(BVHBuildData& data);
+	void StartBackgroundRebuild();
+
+	// Pending objects
+	void AddPending(uint handle);
+	void RemovePending(uint handle);
+
+	// Object handles
+	uint AcquireHandle(GameObject* obj);
+	void ReleaseHandle(uint handle);
+
+private:
+	std::vector<BVHNode> nodes; // nodes[0] is the root
+	std::vector<uint> objectRefs; // the leaves' objects, as handles
+
+	std::vector<GameObject*> objects; // handle -> object
+	std::vector<uint> objectLeaves; // handle -> the leaf that keeps it (or SPATIAL_NONE, pending)
+	std::vector<uint> generations; // handle -> times it has been released
+	std::vector<uint> freeHandles;
+
+	std::vector<uint> pending;
+	std::vector<uint> pendingSlots; // handle -> index in "pending"
+
+	bool changed = false; // since the last build
+	float rebuildTimer = 0.f;
+	std::unique_ptr<BVHBuildData> rebuildData;
+	std::future<void> rebuild;
+};
@@ -0,0 +1,206 @@
+// Headless octree checks: the real Octree, with the few engine pieces it links to stood in for below (no GL and no App).
+// Each check prints one line, and the exit code is the count of the ones failed.
+// Build it with the Makefile next to it. Usage: OctreeChecks
+
+#include "Component.h"
+#include "ComponentCamera.h"
+#include "GameObject.h"
+#include "Octree.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+
+// ----------------------------------------------------------------- [Stand-ins]
+// What the octree needs from the engine, and nothing else of it
+static math::AABB checkView; // the box the frustrum below is built around
+
+void _log(const char file[], int line, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+}
+
+GameObject::GameObject(std::string name, GameObject* parent) : name(name), parent(parent)
+{
+	components.fill(nullptr);
+}
+
+GameObject::~GameObject() {}
+void GameObject::Start() {}
+void GameObject::Enable() {}
+void GameObject::Update(float dt) {}
+void GameObject::Disable() {}
+void GameObject::CleanUp() {}
+void GameObject::OnTransform(bool updateBounding) {}
+
+std::vector<GameObject*> GameObject::GetImmidiateChildren() const
+{
+	return childObjects;
+}
+
+void GameObject::SetBounding(const math::AABB& box)
+{
+	boundingData.AABB = box;
+	boundingData.OBB.SetFrom(box);
+}
+
+Frustrum::Frustrum(ComponentCamera* camera) : myCamera(camera)
+{
+	CalculatePlanes();
+}
+
+// The six faces of "checkView", normals inwards
+void Frustrum::CalculatePlanes()
+{
+	float3 center = checkView.CenterPoint(), half = checkView.HalfSize();
+	for (uint i = 0; i < 6; ++i)
+	{
+		float3 normal = float3::zero;
+		normal[i / 2] = (i % 2 == 0) ? 1.f : -1.f;
+		planes[i].normal = normal;
+		planes[i].center = center - normal.Mul(half);
+	}
+}
+
+void SpatialIndex::DebugAABB(const math::AABB& aabb) {}
+void SpatialIndex::RecordQuery(SPATIAL_QUERY type, const SpatialQueryCounters& counters) const {}
+void SpatialStats::AddNode(uint depth, uint objects, bool leaf) {}
+void SpatialStats::Finish(uint objects) {}
+
+// ----------------------------------------------------------------- [Checks]
+static GameObject* AddBox(std::vector<GameObject*>& objs, const math::AABB& box)
+{
+	GameObject* obj = new GameObject();
+	obj->SetBounding(box);
+	objs.push_back(obj);
+	return obj;
+}
+
+static bool Contains(const std::vector<GameObject*>& found, GameObject* obj)
+{
+	return std::find(found.begin(), found.end(), obj) != found.end();
+}
+
+static bool InView(const Octree& tree, GameObject* obj, const math::AABB& view)
+{
+	checkView = view;
+	Frustrum frustrum(nullptr);
+	std::vector<GameObject*> found;
+	tree.CollectFrustrumCandidates(found, frustrum);
+	return Contains(found, obj);
+}
+
+static bool Report(const char* name, bool passed)
+{
+	printf("%-56s %s\n", name, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+// A static emitter in a classic tree (the default): its particles carry its bounding far from the node it was put in
+static bool EmitterMovesInClassicTree()
+{
+	Octree tree(math::AABB(float3(-100.f), float3(100.f)), 6, 2, 1.f);
+	std::vector<GameObject*> objs;
+	for (int x = 0; x < 4; ++x)
+		for (int z = 0; z < 4; ++z)
+		{
+			float3 min = float3(-90.f + x * 50.f, -1.f, -90.f + z * 50.f);
+			AddBox(objs, math::AABB(min, min + float3(2.f)));
+		}
+	GameObject* emitter = AddBox(objs, math::AABB(float3(-80.f), float3(-78.f)));
+	tree.InsertBatch(objs);
+
+	bool passed = InView(tree, emitter, math::AABB(float3(-82.f), float3(-76.f)));
+
+	// Across the tree, then out of the root
+	emitter->SetBounding(math::AABB(float3(70.f), float3(72.f)));
+	tree.OnObjectMoved(emitter);
+	passed &= InView(tree, emitter, math::AABB(float3(65.f), float3(75.f)));
+	passed &= InView(tree, emitter, math::AABB(float3(-82.f), float3(-76.f))) == false;
+
+	emitter->SetBounding(math::AABB(float3(150.f), float3(152.f)));
+	tree.OnObjectMoved(emitter);
+	passed &= InView(tree, emitter, math::AABB(float3(145.f), float3(155.f)));
+
+	tree.Clear();
+	for (auto& obj : objs)
+		delete obj;
+	return Report("emitter moved in a classic tree stays in view", passed);
+}
+
+// A hot root whose objects are all in one octant of one octant: rebalancing re-splits it, and they must still be found
+static bool ResplitKeepsObjects()
+{
+	Octree tree(math::AABB(float3(-100.f), float3(100.f)), 3, 16, 1.f);
+	std::vector<GameObject*> objs;
+	AddBox(objs, math::AABB(float3(-100.f), float3(100.f))); // in all the octants: stays with the root
+	for (int i = 0; i < 10; ++i)
+		AddBox(objs, math::AABB(float3(56.f + i), float3(57.f + i)));
+	tree.InsertBatch(objs); // fewer than the max: the root stays a leaf
+
+	// A sweep to size the hit counters, queries on the root, and the next sweep finds it hot
+	math::AABB cluster(float3(55.f), float3(67.f));
+	std::vector<GameObject*> found;
+	tree.Update(0.f);
+	for (int i = 0; i < 4; ++i)
+	{
+		found.clear();
+		tree.CollectCandidates(found, SpatialPrimitiveQuery<math::AABB>(cluster), true);
+	}
+	tree.Update(0.f);
+
+	bool passed = tree.GetResplitCount() == 1 && tree.GetNodeCount() > 1;
+	for (auto& obj : objs)
+		passed &= InView(tree, obj, cluster);
+
+	tree.Clear();
+	for (auto& obj : objs)
+		delete obj;
+	return Report("re-split node keeps its objects in view", passed);
+}
+
+// A ray test that runs a query on the same tree, as a pick refining its hit could: the ray must still test each object
+// once, even the ones kept by several of the nodes it goes through
+static bool NestedQueryInRayTest()
+{
+	Octree tree(math::AABB(float3(-100.f), float3(100.f)), 6, 2, 1.f);
+	std::vector<GameObject*> objs;
+	AddBox(objs, math::AABB(float3(-100.f), float3(100.f))); // the root is fit to the objects: this one sets it
+	for (int i = 0; i < 32; ++i)
+		AddBox(objs, math::AABB(float3(-90.f + i * 5.5f, 9.f, 9.f), float3(-88.f + i * 5.5f, 13.f, 13.f)));
+	AddBox(objs, math::AABB(float3(-95.f, 10.f, 10.f), float3(95.f, 12.f, 12.f))); // along the ray, in many nodes
+	tree.InsertBatch(objs);
+
+	std::map<GameObject*, int> tests;
+	auto test = [&tree, &tests](GameObject* obj, float& distance)
+	{
+		tests[obj]++;
+		std::vector<GameObject*> around;
+		math::AABB box = obj->GetBoundingData().AABB;
+		tree.CollectCandidates(around, SpatialPrimitiveQuery<math::AABB>(box), true);
+		return false; // no hit: the ray goes all the way
+	};
+	tree.Raycast(math::LineSegment(float3(-100.f, 11.f, 11.f), float3(100.f, 11.f, 11.f)), test);
+
+	bool passed = tests.size() == objs.size();
+	for (auto& tested : tests)
+		passed &= tested.second == 1;
+
+	tree.Clear();
+	for (auto& obj : objs)
+		delete obj;
+	return Report("query nested in a ray test keeps the ray's visited", passed);
+}
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+	failed += EmitterMovesInClassicTree() ? 0 : 1;
+	failed += ResplitKeepsObjects() ? 0 : 1;
+	failed += NestedQueryInRayTest() ? 0 : 1;
+	return failed;
+}
@@ -0,0 +1,99 @@
+// Headless particle benchmark: the scene's smoke and firework presets, from 1k to 1M particles, at a fixed dt, with
+// no GL and no App (see ParticleSimulation). It reports, in ns, for each step:
+// - update: the kernel, per particle in the pool
+// - spawn: the rest of the step (reclaim, spawn, bounds), per particle in the pool. How many spawn is next to it
+// - sort: the draw order, per live particle
+// Build it with the Makefile next to it. Usage: ParticleBenchmark [frames]
+
+#include "ParticleSimulation.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define BENCH_DT (1.f / 60.f)
+#define BENCH_FRAMES 120 // timed, after a lifespan's worth of frames to fill the pool
+#define BENCH_SEED 42u // the same particles on every run
+
+struct BenchResult
+{
+	double update = 0.0, spawn = 0.0, sort = 0.0; // ns per particle
+	uint live = 0, spawned = 0; // per frame, on average
+};
+
+static double Now()
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static BenchResult Run(AllData data, uint count, uint frames)
+{
+	// Spawns about as fast as they die, so the pool stays about full (the smoke bursts: about half)
+	float lifespan = data.initialState.life.first / data.initialState.life.second;
+	data.emissionData.maxParticles = count;
+	data.emissionData.time = lifespan / (float)count;
+
+	ParticleSimulation sim(data, BENCH_SEED);
+	sim.Resize(count);
+	const float3 origin = float3::zero, camPos = float3(0.f, 5.f, -20.f);
+
+	for (float t = 0.f; t < lifespan; t += BENCH_DT)
+	{
+		sim.Prepare(origin, 1.f);
+		sim.Step(BENCH_DT);
+		sim.Sort(camPos);
+	}
+
+	double update = 0.0, spawn = 0.0, sort = 0.0;
+	unsigned long long spawned = 0, live = 0;
+	for (uint frame = 0; frame < frames; ++frame)
+	{
+		sim.Prepare(origin, 1.f);
+		double start = Now();
+		sim.SimulateRange(BENCH_DT, 0, count);
+		double simulated = Now();
+		sim.Finish(BENCH_DT);
+		double finished = Now();
+		sim.Sort(camPos);
+		double sorted = Now();
+
+		update += simulated - start;
+		spawn += finished - simulated;
+		sort += sorted - finished;
+		spawned += sim.GetSpawnCount();
+		live += sim.GetDrawOrder().Size();
+	}
+
+	BenchResult ret;
+	ret.update = update / ((double)count * frames);
+	ret.spawn = spawn / ((double)count * frames);
+	ret.sort = (live) ? sort / (double)live : 0.0;
+	ret.live = (uint)(live / frames);
+	ret.spawned = (uint)(spawned / frames);
+	return ret;
+}
+
+int main(int argc, char** argv)
+{
+	uint frames = (argc > 1) ? (uint)atoi(argv[1]) : BENCH_FRAMES;
+	if (frames == 0)
+		frames = BENCH_FRAMES;
+
+	ParticleRandom random(BENCH_SEED);
+	struct Preset { const char* name; AllData data; };
+	const Preset presets[] = {
+		{ "smoke", ParticlePresets::Smoke() },
+		{ "firework", ParticlePresets::FireWork(random) }
+	};
+	const uint counts[] = { 1000, 10000, 100000, 1000000 };
+
+	printf("dt %.4f s, %u frames\n", BENCH_DT, frames);
+	printf("%-10s %10s %10s %10s %14s %14s %14s\n", "preset", "particles", "live", "spawned", "update ns/p", "spawn ns/p", "sort ns/p");
+	for (const Preset& preset : presets)
+		for (uint count : counts)
+		{
+			BenchResult result = Run(preset.data, count, frames);
+			printf("%-10s %10u %10u %10u %14.2f %14.2f %14.2f\n", preset.name, count, result.live, result.spawned, result.update, result.spawn, result.sort);
+		}
+
+	return 0;
+}
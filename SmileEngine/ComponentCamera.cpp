@@ -1,6 +1,7 @@
 #include "SmileSetup.h"
 #include "SmileApp.h" 
 #include "ComponentCamera.h"  
+#include "FrustrumCuller.h"
 #include "SafetyHandler.h"
 
 #include "GameObject.h"
@@ -409,17 +410,18 @@ void ComponentCamera::OnInspector(float fovY[1], float pNearDist[1], float pFarD
 // -----------------------------------------------------------------
 void ComponentCamera::PruneInsideFrustrum(std::vector<GameObject*>& candidates)
 {
-	for (auto& obj = candidates.begin(); obj != candidates.end();)
-	{
-		if (frustrum->IsBoxInsideFrustrumView((*obj)->GetBoundingData().OBB)
-			== Frustrum::INTERSECTION_TYPE::OUTSIDE)
-		{
-			obj = candidates.erase(obj); 
-		}
-		else
-			++obj; 
-	}
-	
+	// batch cull the OBBs, then keep the visible ones in place (in order)
+	static CullBoxes boxes; 
+	static std::vector<uint> visible; 
+	boxes.Clear(); 
+	for (auto& obj : candidates)
+		boxes.Push(obj->GetBoundingData().OBB); 
+
+	visible.resize(candidates.size()); 
+	uint count = FrustrumCuller::Cull(CullPlanes(*frustrum), boxes, visible.data()); 
+	for (uint i = 0; i < count; ++i)
+		candidates[i] = candidates[visible[i]]; 
+	candidates.resize(count); 
 }
 
 // -----------------------------------------------------------------
@@ -608,42 +610,3 @@ void Frustrum::DebugPlanes()
 	glPointSize(1);
 	glColor3f(1.f, 1.f, 1.f);
 }
-
-Frustrum::INTERSECTION_TYPE Frustrum::IsBoxInsideFrustrumView(math::OBB box)
-{
-	Frustrum::INTERSECTION_TYPE type = Frustrum::INTERSECTION_TYPE::INSIDE; 
-
-	for (int i = 0; i < 6; ++i) // planes 
-	{
-		int insideCount = 0;
-		int outsideCount = 0; 
-
-		for (int j = 0; j < 8; ++j) // vertices in box
-		{ 
-			float3 vertex = box.CornerPoint(j); 
-			if (planes[i].GetIntersection(vertex) == INTERSECTION_TYPE::OUTSIDE) // outside here means behind 
-				outsideCount++;
-
-			else if (planes[i].GetIntersection(vertex) == INTERSECTION_TYPE::INSIDE)
-				insideCount++; 
-		}
-
-		if (outsideCount == 8)
-			return INTERSECTION_TYPE::OUTSIDE;
-
-
-		if (insideCount > 0)
-			type = INTERSECTION_TYPE::INTERSECT; 
-    }
-
-	return type; 
-}
-
-Frustrum::INTERSECTION_TYPE Frustrum::plane::GetIntersection(float3 vertex)
-{
-	float totalDist = normal.Dot(vertex - center); 
-	if(totalDist >= 0)
-		return INTERSECTION_TYPE::INSIDE;
-
-	return INTERSECTION_TYPE::OUTSIDE; 
-}
\ No newline at end of file
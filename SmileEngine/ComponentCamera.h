@@ -12,6 +12,8 @@
 
 #include <array>
 // ----------------------------------------------------------------- [Frustrum]
+#define FRUSTRUM_ALL_PLANES 0x3F // a bit per plane
+
 class Frustrum
 {
 public: 
@@ -36,7 +38,11 @@ public:
 public: 
 	std::array<plane, 6> GetPlanes() const { return planes; }; 
 	void DebugPlanes(); 
-	INTERSECTION_TYPE IsBoxInsideFrustrumView(math::OBB box);
+	INTERSECTION_TYPE IsBoxInsideFrustrumView(const math::OBB& box);
+	// Center-extent tests against the planes in "planeMask" (bit i = plane i). The planes the box is fully inside of are
+	// taken out of the mask, so a child box (inside its parent) does not need to test them again
+	INTERSECTION_TYPE ClassifyAABB(const float3& center, const float3& halfSize, uint& planeMask) const;
+	INTERSECTION_TYPE ClassifyOBB(const math::OBB& box, uint planeMask) const;
 	void CalculatePlanes();
 private: 
 	std::array<plane, 6> planes;
@@ -5,8 +5,6 @@
 #include "SmileResourceManager.h"
 #include "ResourceMeshPlane.h"
 #include "ResourceMesh.h"
-#include "FreeBillBoard.h"
-#include "FreeTransform.h"
 #include "GameObject.h"
 #include "RNG.h"
 #include "ComponentTransform.h"
@@ -17,58 +15,35 @@
 // TODO: copy the initial values! Maybe have an instance of "initialValues" predefined too for the default ctor 
 
 
-ComponentParticleEmitter::ComponentParticleEmitter(GameObject* parent)
+ComponentParticleEmitter::ComponentParticleEmitter(GameObject* parent) : simulation(data, RNG::GetRandomUUID(), RNG::GetRandomUUID())
 {
 	type = COMPONENT_TYPE::EMITTER;
 	SetName("Emitter"); 
 
 	SetupMesh();
 
-	particles.resize(data.emissionData.maxParticles);
-
-	pVariableFunctions.push_back(&ComponentParticleEmitter::LifeUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::SpeedUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::SizeUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::ColorUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::AnimUpdate);
+	simulation.Resize(data.emissionData.maxParticles);
 }
 
-ComponentParticleEmitter::ComponentParticleEmitter(GameObject* parent, AllData data) : data(data)
+ComponentParticleEmitter::ComponentParticleEmitter(GameObject* parent, AllData data) : simulation(this->data, RNG::GetRandomUUID(), RNG::GetRandomUUID()), data(data)
 {
 	type = COMPONENT_TYPE::EMITTER;
 	SetName("Emitter");
 
 	
-	// 1) Push functions --> Only if the variable changes on time
-	PushFunctions();
-
-	// 2) Get resources   
+	// 1) Get resources   
 	SetupMesh();
 	SetupTexture(); 
 	
-	// 3) Resize the particles buffer   
-	particles.resize(this->data.emissionData.maxParticles);
-}
-
-void ComponentParticleEmitter::PushFunctions()
-{
-	auto initialState = this->data.initialState;
-
-	pVariableFunctions.push_back(&ComponentParticleEmitter::LifeUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::SpeedUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::SizeUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::ColorUpdate);
-	pVariableFunctions.push_back(&ComponentParticleEmitter::AnimUpdate);
-
+	// 2) Resize the particles buffer   
+	simulation.Resize(this->data.emissionData.maxParticles);
 }
 
+// All emitters share the preset quad: the particles' vertices are built each frame, the tiles are in the data
 void ComponentParticleEmitter::SetupMesh()
 {
-
-	mesh = DBG_NEW ResourceMeshPlane(dynamic_cast<RNG*>(App->utilities->GetUtility("RNG"))->GetRandomUUID(), ownMeshType::plane, "Default", float4(1, 0, 0, 0.3f));
-	App->resources->resources.insert(std::pair<SmileUUID, Resource*>(mesh->GetUID(), (Resource*)mesh));
-
-	App->resources->UpdateResourceReferenceCount(mesh->GetUID(), particles.size());
+	mesh = App->resources->Plane;
+	App->resources->UpdateResourceReferenceCount(mesh->GetUID(), 1);
 }
 
 void ComponentParticleEmitter::SetupTexture()
@@ -84,14 +59,7 @@ void ComponentParticleEmitter::SetupTexture()
 
 		this->data.initialState.tex.first = true;
 
-		// Animation 
-		if (this->data.initialState.tex.second > 0.f) // Check anim speed 
-		{
-			pVariableFunctions.push_back(&ComponentParticleEmitter::AnimUpdate);
-
-		}
-
-		App->resources->UpdateResourceReferenceCount(texture->GetUID(), particles.size());
+		App->resources->UpdateResourceReferenceCount(texture->GetUID(), 1);
 	}
 
 }
@@ -111,317 +79,182 @@ ComponentParticleEmitter::~ComponentParticleEmitter()
 
 void ComponentParticleEmitter::CleanUp()  
 {
-	App->resources->UpdateResourceReferenceCount(mesh->GetUID(), -particles.size());
+	App->resources->UpdateResourceReferenceCount(mesh->GetUID(), -1);
 	mesh = nullptr;
 	if (texture)
 	{
-		App->resources->UpdateResourceReferenceCount(texture->GetUID(), -particles.size());
+		App->resources->UpdateResourceReferenceCount(texture->GetUID(), -1);
 		texture = nullptr;
 	}
 
-	pVariableFunctions.clear();
-	particles.clear();
+	simulation.Clear();
 }
 
 // -----------------------------------------------------------------
 void ComponentParticleEmitter::Update(float dt)
+{
+	// Queued: updated with the rest of the frame's emitters, once the objects are
+	App->scene_intro->particleScheduler.Add(this, dt); 
+}
+
+// -----------------------------------------------------------------
+bool ComponentParticleEmitter::PrepareUpdate(float dt)
 {
 	// Check expire time
 	if(data.emissionData.expireTime > 0.f)
 		if ((data.emissionData.totalTime += dt) >= data.emissionData.expireTime)
-		{
-			if (destroyOnFinish == false)
-			{
-				Disable();
-				data.emissionData.totalTime = 0.f;
-				data.emissionData.expireTime = 0.f;
-			}
-			else
-				App->object_manager->toDestroy.push_back(GetParent()); 
-		
-			return; 
-		}
-	
-
-	// Loop particles. Quickly discard inactive ones. Execute only needed functions 
-	for (int i = 0; i < particles.size(); ++i)
-		if(particles.at(i).currentState.life > 0.f)
-			for (auto func = pVariableFunctions.begin(); func != pVariableFunctions.end(); ++func)
-				(this->*(*func))(particles.at(i), dt);
-		
-	// Spawn new particles
-	if (data.emissionData.burstTime > 0.f)
-		BurstAction(dt);
-	else
-		DefaultSpawnAction(dt); 
-		
+			return false; 
+
+	// LOD: the time not simulated waits for the frame it is
+	lod = PickLOD(drawn); 
+	drawn = false; 
+	pendingTime = Min(pendingTime + dt, PARTICLE_LOD_CATCH_UP); 
+	stepTime = 0.f; 
+	if (lod == particleLOD::PAUSED || (lod == particleLOD::REDUCED && ++lodFrame % PARTICLE_LOD_REDUCED_STEP != 0))
+		return true; 
+	stepTime = pendingTime; 
+	pendingTime = 0.f; 
+
+	// What the simulation needs from the scene, as it is now
+	float3 origin = GetParent()->GetTransform()->GetGlobalPosition(); 
+	simulation.Prepare(origin, mesh->GetQuadSize(), (lod == particleLOD::REDUCED) ? PARTICLE_LOD_REDUCED_SPAWN : 1.f); 
+
+	return true; 
 }
 
 // -----------------------------------------------------------------
-void ComponentParticleEmitter::BurstAction(float dt)
+// Not drawn (culled) waits, unless it has no particles yet: it does not know how far they go
+particleLOD ComponentParticleEmitter::PickLOD(bool visible) const
 {
-	static bool burst = false;
-
-	if ((data.emissionData.currentBurstTime += dt) >= data.emissionData.burstTime)
-	{
-		data.emissionData.currentBurstTime = 0;
-		burst = !burst;
-	}
-
-	if (burst == false)
-		DefaultSpawnAction(dt); 
+	if (data.emissionData.lod == false)
+		return particleLOD::FULL; 
+	if (visible == false && simulation.GetLiveBounds().IsFinite())
+		return particleLOD::PAUSED; 
+
+	float3 camPos = App->scene_intro->gameCamera->GetParent()->GetTransform()->GetGlobalPosition(); 
+	float distance = GetParent()->GetBoundingData().AABB.Distance(camPos); 
+	return (distance > data.emissionData.lodDistance) ? particleLOD::REDUCED : particleLOD::FULL; 
 }
 
 // -----------------------------------------------------------------
-void ComponentParticleEmitter::DefaultSpawnAction(float dt)
+void ComponentParticleEmitter::SimulateRange(uint first, uint last)
 {
-	if ((data.emissionData.currenTime += dt) > data.emissionData.time)
-		SpawnParticle();
+	simulation.SimulateRange(stepTime, first, last);
 }
 
 // -----------------------------------------------------------------
-void ComponentParticleEmitter::Draw()
+void ComponentParticleEmitter::FinishUpdate()
 {
-	// Sort
-	drawParticles = particles; 
-	std::sort(drawParticles.begin(), drawParticles.end());
-
-	// Blit  
-	for (auto& p : drawParticles)
-		if (p.currentState.life > 0.f)
-			mesh->BlitMeshHere(p.transf.GetGlobalMatrix(),
-				p.currentState.needTileUpdate,
-			(data.initialState.tex.first) ? texture : nullptr,
-				data.blendmode, p.currentState.transparency, p.currentState.color,
-				((data.initialState.tex.second > 0.f) ? p.currentState.tileIndex : INFINITE));
-
-	drawParticles.clear();
+	simulation.Finish(stepTime); 
 }
 
-
 // -----------------------------------------------------------------
-inline static int FindAvailableParticleIndex(std::vector<Particle>& particles, uint& lastUsedParticle)
+// The object's box, so it is culled with its particles. Only once they leave it, or fill much less of it
+void ComponentParticleEmitter::CommitUpdate()
 {
-	for (int i = lastUsedParticle; i < particles.size(); i++) 
-	{
-		if (particles[i].currentState.life <= 0.f)
-		{
-			lastUsedParticle = i;
-			return i;
-		}
-	}
+	const math::AABB& liveBounds = simulation.GetLiveBounds(); 
+	if (liveBounds.IsFinite() == false)
+		return; 
 
-	for (int i = 0; i < lastUsedParticle; i++)
-	{
-		if (particles[i].currentState.life <= 0.f) 
-		{
-			lastUsedParticle = i;
-			return i;
-		}
-	}
+	math::AABB current = GetParent()->GetBoundingData().AABB; 
+	if (current.Contains(liveBounds) && liveBounds.Volume() >= current.Volume() * 0.25f)
+		return; 
 
-	return 0; 
+	math::AABB box = liveBounds; 
+	float3 margin = box.Size() * PARTICLE_BOUNDS_MARGIN; 
+	box.minPoint -= margin; 
+	box.maxPoint += margin; 
+	GetParent()->SetBounding(box); 
+	App->spatial_tree->OnObjectMoved(GetParent()); 
 }
 
 // -----------------------------------------------------------------
-void ComponentParticleEmitter::SpawnParticle()
+void ComponentParticleEmitter::CommitFinish()
 {
-	// 1) Reset Emission Time
-	data.emissionData.currenTime = 0.f;
-
-	// 2) Find Available Particle
-	Particle& p = particles[FindAvailableParticleIndex(particles, lastUsedParticle)]; 
-
-	// 3) Set Particle State
-	p.currentState.transparency = data.initialState.transparency;
-	p.currentState.life = data.initialState.life.first;
-	p.currentState.size = data.initialState.size.first;
-	auto scale = float3::FromScalar(p.currentState.size);
-	 
-	// Initial speed and color can be random:
-	bool randomC = data.emissionData.randomColor;
-	p.currentState.color = (randomC) ? (p.currentState.randomData.color = GetRandomRange4(std::pair(float4::zero, float4::one))) : data.initialState.color.first;
-	bool randomS = data.emissionData.randomSpeed.first; 
-	
-	if (randomS == false) {
-		p.currentState.speed = data.initialState.speed;
-	}
-	else 
+	if (destroyOnFinish == false)
 	{
-		if ((data.emissionData.randomSpeed.second.second.IsFinite())) {
-			p.currentState.randomData.speed = GetRandomRange(data.emissionData.randomSpeed.second);
-		}
-		else
-		{
-			p.currentState.randomData.speed = GetRandomRange(data.emissionData.randomSpeed.second.first);
-		}
+		Disable();
+		data.emissionData.totalTime = 0.f;
+		data.emissionData.expireTime = 0.f;
 	}
-		 
-	// 4) Set particle Transform
-	p.transf.parentMatrix = GetParent()->GetTransform()->GetGlobalMatrix(); 
-	p.transf.UpdateGlobalMatrix(math::float4x4::FromTRS(GetSpawnPos(), float4x4::identity, scale));
+	else if (effect != particleEffect::NONE)
+		App->scene_intro->particleEffects.Release(GetParent()); 
+	else
+		App->object_manager->toDestroy.push_back(GetParent()); 
 }
 
-float3 ComponentParticleEmitter::GetSpawnPos()
+// -----------------------------------------------------------------
+// As if just created with this data, for the effect pool. Nothing is allocated if the particle count is the same
+void ComponentParticleEmitter::Restart(const AllData& data)
 {
-	auto pos = GetParent()->GetTransform()->GetGlobalPosition(); 
-	auto copy = pos; 
-	switch (data.emissionData.shape)
-	{
-	case emmissionShape::CIRCLE:
-	{
-		pos += GetRandomRange(data.emissionData.spawnRadius);
-		pos.y = copy.y; 
-		break; 
-	}
-	case emmissionShape::SPHERE:
+	// The texture keeps its one reference, unless it is another one
+	bool sameTexture = this->data.emissionData.texPath == data.emissionData.texPath; 
+	this->data = data; 
+	if (sameTexture == false)
 	{
-		pos += GetRandomRange(data.emissionData.spawnRadius);
-		break;
+		if (texture)
+			App->resources->UpdateResourceReferenceCount(texture->GetUID(), -1);
+		texture = nullptr; 
+		SetupTexture(); 
 	}
-	case emmissionShape::CONE:
-	{
-		
-		break;
-	}
-	
-	default:
-		break;
-	}
-
-	return pos;
-}
+	else if (texture)
+		this->data.initialState.tex.first = true; 
 
-// ----------------------------------------------------------------- Update Values
-inline void ComponentParticleEmitter::LifeUpdate(Particle& p, float dt)
-{
-	p.currentState.currentLifeTime += dt; 
+	if (simulation.particles.Size() != data.emissionData.maxParticles)
+		simulation.Resize(data.emissionData.maxParticles); 
+	simulation.Restart(); 
 
-	if ((p.currentState.life -= data.initialState.life.second * dt) <= 0.f)
-	{
-		p.currentState.life = p.currentState.currentLifeTime = 0.f;
-		p.camDist = -floatMax; 
-	}
-		
+	lod = particleLOD::FULL; 
+	stepTime = pendingTime = 0.f; 
+	lodFrame = 0; 
+	drawn = false; 
 }
 
 // -----------------------------------------------------------------
-inline void ComponentParticleEmitter::SpeedUpdate(Particle& p, float dt)
-{
-	// Add the speed to the particle transform pos. Update the billboard too. Gravity? Yet another variable in the emitter xd
-	auto pos = p.transf.globalMatrix.TranslatePart();
-	float3 delta = (p.currentState.randomData.speed.IsFinite()) ? (p.currentState.randomData.speed * dt) : (data.initialState.speed * dt);
-	if (data.emissionData.gravity)
-		delta += float3(0, -GLOBAL_GRAVITY * p.currentState.currentLifeTime * dt, 0); 
-
-	p.transf.globalMatrix.SetTranslatePart(pos += delta);
-
-	// Update camera distance
-	auto camMatrix = App->scene_intro->gameCamera->GetViewMatrixF(); 
-	p.camDist = (p.transf.globalMatrix.TranslatePart() - camMatrix.TranslatePart()).Length();
-
-	// Update Billboard
-	p.billboard.Update(camMatrix, FreeBillBoard::Alignment::world, nullptr, p.transf); 
-}
-
-// -----------------------------------------------------------------
-inline void ComponentParticleEmitter::ColorUpdate(Particle& p, float dt)
-{
-	if (data.emissionData.randomColor)
-		return;
-
-	float4 initVal = (data.emissionData.randomColor) ? p.currentState.randomData.color : data.initialState.color.first; 
-	float4 endVal = data.initialState.color.second; 
-
-	if (endVal.IsFinite() == false)
-		return; 
-
-	float lifePercentatge = 1 - (p.currentState.life / data.initialState.life.first); 
-	for (int i = 0; i < 4; ++i)
-		p.currentState.color[i] = initVal[i] + lifePercentatge * (endVal[i] - initVal[i]); 
-
-    // c = init + inverse percentage * range 
-}
-
-// -----------------------------------------------------------------
-inline void ComponentParticleEmitter::AnimUpdate(Particle& p, float dt)
-{
-	if (data.initialState.tex.second == 0.f)
-		return; 
-	
-	if ((p.currentState.lastTileframe += dt) >= data.initialState.tex.second)
-	{
-		p.currentState.tileIndex = ((p.currentState.tileIndex + 1) < mesh->tileData->maxTiles -1) ?
-			(p.currentState.tileIndex + 1) : 0; 
-		p.currentState.lastTileframe = 0.f; 
-		p.currentState.needTileUpdate = true;
-	};
-
-}
-
-
-// -----------------------------------------------------------------
-inline void ComponentParticleEmitter::SizeUpdate(Particle& p, float dt)
-{
-	auto t = p.transf.GetGlobalMatrix();
-	float initVal = data.initialState.size.first;
-	float endVal = data.initialState.size.second;
-	float lifePercentatge = 1 - (p.currentState.life / data.initialState.life.first);
-	p.currentState.size = initVal + lifePercentatge * (endVal - initVal);
-	auto sc = float3::FromScalar(p.currentState.size); 
-	p.transf.ChangeScale(sc); 
-}
-
-// ----------------------------------------------------------------- [Utilities]
-float3 ComponentParticleEmitter::GetRandomRange(std::variant<float3, std::pair<float3, float3>> ranges)
+void ComponentParticleEmitter::Draw()
 {
-	float3 ret = float3::zero;
-
-	if (ranges.index() == 0)
+	drawn = true; 
+	auto camComp = App->scene_intro->gameCamera; 
+	float4x4 camMatrix = camComp->GetViewMatrixF(); 
+	float3 camPos = camComp->GetParent()->GetTransform()->GetGlobalPosition(); 
+
+	// Sort the live ones, back to front
+	simulation.Sort(camPos); 
+	const ParticleSorter& drawOrder = simulation.GetDrawOrder(); 
+	ParticleBuffer& particles = simulation.particles; 
+
+	// The quads, facing the camera: in its plane, so its right and up are the same for all of them.
+	// The corners' offsets for size 1, in the plane's points order
+	float halfSize = mesh->GetQuadSize() * 0.5f; 
+	float3 right = camMatrix.WorldX().Normalized() * halfSize; 
+	float3 up = camMatrix.WorldY().Normalized() * halfSize; 
+	const float3 corners[4] = { up - right, -right - up, right - up, right + up }; 
+	bool tiled = data.initialState.tex.second > 0.f; 
+	float2 uvs[4]; 
+	mesh->GetTileUvs(data.tiles, INFINITE, uvs); 
+
+	vertices.resize(drawOrder.Size() * 4); 
+	ParticleVertex* v = vertices.data(); 
+	for (uint k = 0; k < drawOrder.Size(); ++k)
 	{
-		auto range = std::get<float3>(ranges);
-		range.x = math::Abs(range.x); 
-		range.y = math::Abs(range.y);
-		range.z = math::Abs(range.z);
-
-		ret.x = std::get<float>(RNG::GetRandomValue(-range.x / 2, range.x / 2));
-		ret.y = std::get<float>(RNG::GetRandomValue(-range.y / 2, range.y / 2));
-		ret.z = std::get<float>(RNG::GetRandomValue(-range.z / 2, range.z / 2));
-	}
-	else
-	{
-		auto range = std::get<std::pair<float3, float3>>(ranges);
-		ret.x = std::get<float>(RNG::GetRandomValue(range.first.x, range.second.x));
-		ret.y = std::get<float>(RNG::GetRandomValue(range.first.y, range.second.y));
-		ret.z = std::get<float>(RNG::GetRandomValue(range.first.z, range.second.z));
+		uint i = drawOrder[k]; 
+		float3 pos = particles.GetPosition(i); 
+		float size = particles.size[i]; 
+
+		float4 color = particles.GetColor(i); 
+		if (color.IsFinite() == false)
+			color = float4::one; 
+		if (tiled)
+			mesh->GetTileUvs(data.tiles, particles.tile[i], uvs); 
+
+		for (uint c = 0; c < 4; ++c)
+			*v++ = { pos + corners[c] * size, uvs[c], color };
 	}
 
-	return ret;
+	// Blit them all at once
+	mesh->BlitParticles(vertices, (data.initialState.tex.first) ? texture : nullptr, data.blendmode, data.initialState.transparency);
 }
 
-float4 ComponentParticleEmitter::GetRandomRange4(std::variant<float4, std::pair<float4, float4>> ranges)
-{
-	float4 ret = float4::zero;
-
-	if (ranges.index() == 0)
-	{
-		auto range = std::get<float4>(ranges);
-		ret.x = std::get<float>(RNG::GetRandomValue(-range.x / 2, range.x / 2));
-		ret.y = std::get<float>(RNG::GetRandomValue(-range.y / 2, range.y / 2));
-		ret.z = std::get<float>(RNG::GetRandomValue(-range.z / 2, range.z / 2));
-		ret.w = std::get<float>(RNG::GetRandomValue(-range.w / 2, range.w / 2));
-	}
-	else
-	{
-		auto range = std::get<std::pair<float4, float4>>(ranges);
-		ret.x = std::get<float>(RNG::GetRandomValue(range.first.x, range.second.x));
-		ret.y = std::get<float>(RNG::GetRandomValue(range.first.y, range.second.y));
-		ret.z = std::get<float>(RNG::GetRandomValue(range.first.z, range.second.z));
-		ret.w = std::get<float>(RNG::GetRandomValue(range.first.w, range.second.w));
-	}
-
-	return ret;
-}
 
 // -----------------------------------------------------------------
 void ComponentParticleEmitter::SetNewTexture(const char* path)
@@ -436,26 +269,23 @@ void ComponentParticleEmitter::SetNewTexture(const char* path)
 	if (newTexture == nullptr)
 		return;
 
-	if (newTexture)
-	{
-		texture = newTexture; 
-		App->resources->UpdateResourceReferenceCount(texture->GetUID(), -particles.size());
-	}
+	// One reference for the emitter. The new one's first: it may be the same
+	App->resources->UpdateResourceReferenceCount(newTexture->GetUID(), 1);
+	if (texture)
+		App->resources->UpdateResourceReferenceCount(texture->GetUID(), -1);
+	texture = newTexture; 
 
 	this->data.emissionData.texPath = path;
 	texture->LoadOnMemory(this->data.emissionData.texPath.c_str());
 		
 	this->data.initialState.tex.first = true;
-	App->resources->UpdateResourceReferenceCount(texture->GetUID(), particles.size());
 }
 
 
 // -----------------------------------------------------------------
 void ComponentParticleEmitter::SetMaxParticles(uint maxParticles)
 {
-	particles.resize(data.emissionData.maxParticles = maxParticles); 
-	if (lastUsedParticle > particles.size())
-		lastUsedParticle = particles.size(); 
+	simulation.Resize(data.emissionData.maxParticles = maxParticles); 
 }
 
 void ComponentParticleEmitter::OnSave(rapidjson::Writer<rapidjson::StringBuffer>& writer)
@@ -471,8 +301,14 @@ void ComponentParticleEmitter::OnSave(rapidjson::Writer<rapidjson::StringBuffer>
 	writer.Key("Max Particles");
 	writer.Uint(data.emissionData.maxParticles);
 
-	writer.Key("Last Used Particle");
-	writer.Uint(lastUsedParticle);
+	writer.Key("Full Pool");
+	writer.String((data.emissionData.fullPool == fullPoolPolicy::REPLACE_OLDEST) ? "REPLACE OLDEST" : "SKIP");
+
+	writer.Key("LOD");
+	writer.Bool(data.emissionData.lod);
+
+	writer.Key("LOD Distance");
+	writer.Double(data.emissionData.lodDistance);
 	   
 	writer.Key("Bounding Box Radius");
 	writer.Double(GetParent()->GetBoundingData().OBB.Size().Length());
@@ -633,17 +469,18 @@ void ComponentParticleEmitter::OnSave(rapidjson::Writer<rapidjson::StringBuffer>
 	writer.Double(data.initialState.tex.second);
 
 	writer.Key("Number of Tiles");
-	writer.Int(mesh->tileData->maxTiles);
+	writer.Int(data.tiles.maxTiles);
 	writer.Key("Number of Rows");
-	writer.Int(mesh->tileData->nRows);
+	writer.Int(data.tiles.nRows);
 	writer.Key("Number of Columns");
-	writer.Int(mesh->tileData->nCols);
+	writer.Int(data.tiles.nCols);
 
 	
 	
 
 
 	// Particles
+	const ParticleBuffer& particles = simulation.particles; 
 	writer.Key("Particles");
 	writer.StartArray();
 
@@ -654,25 +491,25 @@ void ComponentParticleEmitter::OnSave(rapidjson::Writer<rapidjson::StringBuffer>
 		writer.StartObject();
 
 		writer.Key("Active");
-		writer.Bool(particles.at(i).currentState.active);
+		writer.Bool(particles.IsAlive(i));
 		
 		writer.Key("Speed");
 		writer.StartArray();
-		writer.Double(particles.at(i).currentState.speed.x);
-		writer.Double(particles.at(i).currentState.speed.y);
-		writer.Double(particles.at(i).currentState.speed.z);
+		writer.Double(particles.speedX[i]);
+		writer.Double(particles.speedY[i]);
+		writer.Double(particles.speedZ[i]);
 		writer.EndArray();
 
 		writer.Key("Life");
-		writer.Double(particles.at(i).currentState.life);
+		writer.Double(particles.life[i]);
 
 		writer.Key("Current Life Time");
-		writer.Double(particles.at(i).currentState.currentLifeTime);
+		writer.Double(particles.lifeTime[i]);
 		
 
 		float4 colorValue(666, 666, 666, 666); 
-		if (particles.at(i).currentState.color.IsFinite())
-			colorValue = particles.at(i).currentState.color;
+		if (particles.GetColor(i).IsFinite())
+			colorValue = particles.GetColor(i);
 
 		writer.Key("Color");
 		writer.StartArray();
@@ -684,57 +521,42 @@ void ComponentParticleEmitter::OnSave(rapidjson::Writer<rapidjson::StringBuffer>
 
 
 		writer.Key("Size");
-		writer.Double(particles.at(i).currentState.size);
+		writer.Double(particles.size[i]);
 		
 		writer.Key("Transparency");
-		writer.Double(particles.at(i).currentState.transparency);
+		writer.Double(data.initialState.transparency);
 		
 		writer.Key("Tile Index");
-		writer.Uint(particles.at(i).currentState.tileIndex);
+		writer.Uint(particles.tile[i]);
 	
 		writer.Key("Last Tile Frame");
-		writer.Double(particles.at(i).currentState.lastTileframe);
-		
-		writer.Key("Need Tile Update");
-		writer.Bool(particles.at(i).currentState.needTileUpdate);
+		writer.Double(particles.tileTime[i]);
 		
+		// The speed is the same, random or not
 		writer.Key("Random Speed");
 		writer.StartArray();
-		auto value = float3(666);
-		if (particles.at(i).currentState.randomData.speed.IsFinite() == true)
-		{
-			value.x = particles.at(i).currentState.randomData.speed.x;
-			value.y = particles.at(i).currentState.randomData.speed.y;
-			value.z = particles.at(i).currentState.randomData.speed.z;
-		}
-		writer.Double(value.x);
-		writer.Double(value.y);
-		writer.Double(value.z);
+		writer.Double(particles.speedX[i]);
+		writer.Double(particles.speedY[i]);
+		writer.Double(particles.speedZ[i]);
 		writer.EndArray();
 
 
 
 		writer.Key("Random Color");
 		writer.StartArray();
-		auto valueC = float4(666,666,666,666);
-		if (particles.at(i).currentState.randomData.color.IsFinite() == true)
-		{
-			valueC.x = particles.at(i).currentState.randomData.color.x;
-			valueC.y = particles.at(i).currentState.randomData.color.y;
-			valueC.z = particles.at(i).currentState.randomData.color.z;
-			valueC.w = particles.at(i).currentState.randomData.color.w;
-		}
-		writer.Double(valueC.x);
-		writer.Double(valueC.y);
-		writer.Double(valueC.z);
-		writer.Double(valueC.w);
+		writer.Double(colorValue.x);
+		writer.Double(colorValue.y);
+		writer.Double(colorValue.z);
+		writer.Double(colorValue.w);
 		writer.EndArray();
 
 		writer.Key("Cam Distance");
-		writer.Double(particles.at(i).camDist);
+		writer.Double(particles.camDist[i]);
 
+		// Particles live in world space: both matrices are the same
+		float4x4 matrix = float4x4::FromTRS(particles.GetPosition(i), float4x4::identity, float3::FromScalar(particles.size[i]));
 		writer.Key("Global Matrix");
-		float* m = particles.at(i).transf.globalMatrix.ptr();
+		float* m = matrix.ptr();
 		writer.StartArray();
 		for (int i = 0; i < 16; ++i)
 		{
@@ -743,11 +565,10 @@ void ComponentParticleEmitter::OnSave(rapidjson::Writer<rapidjson::StringBuffer>
 		writer.EndArray();
 
 		writer.Key("Local Matrix");
-		float* mLocal = particles.at(i).transf.localMatrix.ptr();
 		writer.StartArray();
 		for (int i = 0; i < 16; ++i)
 		{
-			writer.Double(mLocal[i]);
+			writer.Double(m[i]);
 		}
 		writer.EndArray();
 		writer.EndObject();
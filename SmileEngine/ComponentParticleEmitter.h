@@ -9,95 +9,23 @@
 #include "MathGeoLib/include/Math/float4x4.h"
 
 #include "Component.h"
+#include "ParticleSimulation.h"
+#include "JSONParser.h"
 
+enum class particleLOD { FULL, REDUCED, PAUSED }; // far: updated less often, and spawns less. Not drawn: waits, then catches up
 
-#include "FreeBillBoard.h"
-#include "FreeTransform.h"
+#define PARTICLE_LOD_REDUCED_STEP 3 // frames per update, when far
+#define PARTICLE_LOD_REDUCED_SPAWN 0.5f // of the spawn rate, when far
+#define PARTICLE_LOD_CATCH_UP 1.f // seconds simulated at once, at most, once it is drawn again
+#define PARTICLE_BOUNDS_MARGIN 0.1f // of the particles' box size, so the object's box is not updated every frame
 
-struct InitialRandomState
-{
-	float3 speed = float3::inf; 
-	float4 color = float4::inf; 
-};
-
-struct CurrentState
-{
-	bool active;
-	float life;
-	float currentLifeTime; 
-	float3 speed;
-	float size;
-	float transparency;
-	float4 color = float4::inf;
-	uint tileIndex = 0;  
-	float lastTileframe = 0.f; 
-	bool needTileUpdate = false; 
-	// Stuff that is random, per-particle, can be stored here for updation:
-	InitialRandomState randomData;
-};
-
-struct Particle
-{
-	FreeTransform transf;
-	FreeBillBoard billboard;
-	CurrentState currentState;
-
-	float camDist = -floatMax; 
-	bool operator<(Particle& other) { return this->camDist > other.camDist; }
-};
-
-struct InitialState
-{
-	// This Variables will be updated each frame if they have value over time (Current order: 0->5)
-	std::pair<float, float> life = std::pair(1.f, 1.f);
-	float3 speed = float3(0, 1, 0); // default
-	std::pair<float, float> size = std::pair(1.f, 1.f); // initial & final
-	float transparency = 0.f; 
-	std::pair<float4, float4> color = std::pair(float4::inf, float4::inf); // initial & final
-	std::pair<bool, float> tex = std::pair(false, 0.f); // has & anim speed 
-
-};
-
-enum class emmissionShape { CIRCLE, SPHERE, CONE }; 
-enum class blendMode { ADDITIVE, ALPHA_BLEND };
-
-
-struct EmissionData
-{
-	bool gravity = true; 
-	uint maxParticles = 100;
-	std::string texPath = "empty"; 
-	std::pair<bool, std::pair<float3, float3>> randomSpeed = std::pair(false, std::pair(float3::inf, float3::inf));
-	bool randomColor = false; 
-	float time = 0.5f, burstTime = 0.f, currenTime = 0.f,
-		currentBurstTime = 0.f, expireTime = 0.f, totalTime = 0.f;
-	float3 spawnRadius = float3(5.f); // the radius or inner + outer
-	emmissionShape shape = emmissionShape::CONE;
-};
-
-// This struct has it all: 
-struct AllData
-{
-	// Generation
-	EmissionData emissionData; 
-
-	// Initial State
-	InitialState initialState;
-	// Modes
-	blendMode blendmode = blendMode::ALPHA_BLEND;
-
-};
-
-
-class ComponentParticleEmitter; 
-typedef void (ComponentParticleEmitter::*function)(Particle& p, float dt);
 
 class ResourceMeshPlane;
 class ResourceTexture;
 class GameObject; 
 class ComponentTransform; 
 
-#define GLOBAL_GRAVITY 0.5f 
+// The simulation is ParticleSimulation's: the emitter gives it its place in the scene, and draws it
 class ComponentParticleEmitter: public Component
 {
 public: 
@@ -106,16 +34,27 @@ public:
 	~ComponentParticleEmitter();
 
 public: 
-	void Update(float dt = 0); 
+	void Update(float dt = 0); // queues it (see ParticleScheduler)
 	void Draw();
 	void CleanUp(); 
 	void Enable() { active = true; data.emissionData.expireTime = 0.f; };
+	void Restart(const AllData& data); // as new, keeping the memory (see ParticleEffectPool)
 
 	// Setters & Getters
 	void SetNewTexture(const char* path); 
 	void SetMaxParticles(uint maxParticles);
 	AllData GetData() { return data; };
 	
+	// Update, in steps (see ParticleScheduler). Only the commits touch anything but the emitter
+	bool PrepareUpdate(float dt); // false if it expired. Picks the LOD: there may be nothing to simulate this frame
+	void SimulateRange(uint first, uint last); // [first, last), at once with other ranges
+	void FinishUpdate(); // the dead out, the new in
+	void CommitUpdate(); // the object's bounds, from the live particles
+	void CommitFinish(); // disabled, or destroyed
+	uint GetParticleCount() const { return simulation.particles.Size(); };
+	float GetStepTime() const { return stepTime; }; // this frame's. 0: skipped
+	particleLOD GetLOD() const { return lod; };
+
 	// Save & Load
 	void OnSave(rapidjson::Writer<rapidjson::StringBuffer>& writer);
 
@@ -123,34 +62,25 @@ private:
 	// Start
 	void SetupMesh(); 
 	void SetupTexture(); 
-	void PushFunctions(); 
-
-	// Spawn
-	void SpawnParticle(); 
-	void BurstAction(float dt); 
-	void DefaultSpawnAction(float dt); 
-	float3 GetSpawnPos(); 
-
-	// Utilities
-	float3 GetRandomRange(std::variant<float3, std::pair<float3, float3>> ranges);
-	float4 GetRandomRange4(std::variant<float4, std::pair<float4, float4>> ranges);
 
-	// Particle Updation
-	inline void LifeUpdate(Particle& p, float dt);
-	inline void SpeedUpdate(Particle& p, float dt);
-	inline void SizeUpdate(Particle& p, float dt);  
-	inline void ColorUpdate(Particle& p, float dt);
-	inline void AnimUpdate(Particle& p, float dt); 
+	// Update
+	particleLOD PickLOD(bool visible) const; 
 
 private: 
-	uint lastUsedParticle = 0;
-	std::vector<Particle> particles, drawParticles; 
-	std::vector<function> pVariableFunctions; // They co-relate by order to particle state variables (Current order: 0->5)
+	ParticleSimulation simulation; // of the data below
+	std::vector<ParticleVertex> vertices; // in draw order
+
+	// LOD and bounds
+	particleLOD lod = particleLOD::FULL; 
+	float stepTime = 0.f, pendingTime = 0.f; // to simulate this frame, and not simulated yet
+	uint lodFrame = 0; 
+	bool drawn = false; // since the last update
 	
 public: 
-	bool destroyOnFinish = false; 
+	bool destroyOnFinish = false; // back to the effect pool instead, if it came from there
+	particleEffect effect = particleEffect::NONE; // pooled, if not NONE
 	ResourceMeshPlane* mesh = nullptr; 
-	ResourceTexture* texture = nullptr; 
+	ResourceTexture* texture = nullptr; // one reference, whatever the particle count
 	AllData data;
 
 
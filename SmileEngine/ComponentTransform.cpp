@@ -77,6 +77,10 @@ void ComponentTransform::SetGlobalMatrix(float4x4 mat)
 	}
 	else
 		localMatrix =  (globalMatrix = mat);
+
+	// Same as when calculating the global matrix: warn the parent (bounding, octree...)
+	if (parent && parent->GetCamera() == nullptr)
+		parent->OnTransform(); 
 	LOG("Object has a position after global update --> (%f,%f,%f)", GetGlobalPosition().x, GetGlobalPosition().y, GetGlobalPosition().z);
 }
 
@@ -16,7 +16,6 @@ enum COMPONENT_TYPE : uint
 };
 
 #include "DevIL/include/IL/il.h"
-typedef ILubyte;
 struct textureData
 {
 	uint id_texture = 0;
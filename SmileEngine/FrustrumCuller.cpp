@@ -0,0 +1,318 @@
+#include "FrustrumCuller.h"
+#include "GameObject.h"
+#include "Component.h"
+#include "ComponentCamera.h"
+#include "pcg/include/pcg_random.hpp"
+#include <chrono>
+#include <random>
+
+#ifdef CULL_SSE
+#include <emmintrin.h>
+#endif
+#ifdef CULL_AVX
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------------------- [Frustrum box tests]
+// The frustrum's own tests, one box at a time. Here with the batch ones, away from the camera and GL
+Frustrum::INTERSECTION_TYPE Frustrum::IsBoxInsideFrustrumView(const math::OBB& box)
+{
+	Frustrum::INTERSECTION_TYPE type = Frustrum::INTERSECTION_TYPE::INSIDE; 
+	float3 corners[8]; 
+	box.GetCornerPoints(corners); 
+
+	for (int i = 0; i < 6; ++i) // planes 
+	{
+		int insideCount = 0;
+		int outsideCount = 0; 
+
+		for (int j = 0; j < 8; ++j) // vertices in box
+		{ 
+			INTERSECTION_TYPE vertexType = planes[i].GetIntersection(corners[j]); 
+			if (vertexType == INTERSECTION_TYPE::OUTSIDE) // outside here means behind 
+				outsideCount++;
+
+			else if (vertexType == INTERSECTION_TYPE::INSIDE)
+				insideCount++; 
+		}
+
+		if (outsideCount == 8)
+			return INTERSECTION_TYPE::OUTSIDE;
+
+
+		if (insideCount > 0)
+			type = INTERSECTION_TYPE::INTERSECT; 
+    }
+
+	return type;
+}
+
+Frustrum::INTERSECTION_TYPE Frustrum::plane::GetIntersection(float3 vertex)
+{
+	float totalDist = normal.Dot(vertex - center);
+	if(totalDist >= 0)
+		return INTERSECTION_TYPE::INSIDE;
+
+	return INTERSECTION_TYPE::OUTSIDE;
+}
+
+Frustrum::INTERSECTION_TYPE Frustrum::ClassifyAABB(const float3& center, const float3& halfSize, uint& planeMask) const
+{
+	for (uint i = 0; i < 6; ++i)
+	{
+		if ((planeMask & (1 << i)) == 0)
+			continue; 
+
+		// distance from the box center to the plane, and the box "radius" projected on the normal
+		const float3& n = planes[i].normal; 
+		float d = n.Dot(center - planes[i].center); 
+		float r = Abs(n.x) * halfSize.x + Abs(n.y) * halfSize.y + Abs(n.z) * halfSize.z; 
+
+		if (d + r < 0)  // normals point inwards: behind
+			return INTERSECTION_TYPE::OUTSIDE; 
+		if (d - r >= 0)
+			planeMask &= ~(1 << i); 
+	}
+
+	return (planeMask == 0) ? INTERSECTION_TYPE::INSIDE : INTERSECTION_TYPE::INTERSECT; 
+}
+
+Frustrum::INTERSECTION_TYPE Frustrum::ClassifyOBB(const math::OBB& box, uint planeMask) const
+{
+	Frustrum::INTERSECTION_TYPE type = Frustrum::INTERSECTION_TYPE::INSIDE;
+
+	for (uint i = 0; i < 6; ++i)
+	{
+		if ((planeMask & (1 << i)) == 0)
+			continue;
+
+		const float3& n = planes[i].normal;
+		float d = n.Dot(box.pos - planes[i].center);
+		float r = Abs(n.Dot(box.axis[0])) * box.r.x + Abs(n.Dot(box.axis[1])) * box.r.y + Abs(n.Dot(box.axis[2])) * box.r.z;
+
+		if (d + r < 0)
+			return INTERSECTION_TYPE::OUTSIDE;
+		if (d - r < 0)
+			type = INTERSECTION_TYPE::INTERSECT;
+	}
+
+	return type;
+}
+
+// ----------------------------------------------------------------- [Planes and boxes]
+CullPlanes::CullPlanes(const Frustrum& frustrum)
+{
+	auto planes = frustrum.GetPlanes(); 
+	for (uint i = 0; i < 6; ++i)
+	{
+		nX[i] = planes[i].normal.x;
+		nY[i] = planes[i].normal.y;
+		nZ[i] = planes[i].normal.z;
+		d[i] = -planes[i].normal.Dot(planes[i].center); 
+	}
+}
+
+void CullBoxes::Push(const math::OBB& box)
+{
+	posX.push_back(box.pos.x); 
+	posY.push_back(box.pos.y);
+	posZ.push_back(box.pos.z);
+	rX.push_back(box.r.x);
+	rY.push_back(box.r.y);
+	rZ.push_back(box.r.z);
+	for (uint i = 0; i < 3; ++i)
+		for (uint j = 0; j < 3; ++j)
+			axis[i * 3 + j].push_back(box.axis[i][j]); 
+}
+
+void CullBoxes::Push(const math::AABB& box)
+{
+	math::OBB obb; 
+	obb.pos = box.CenterPoint(); 
+	obb.r = box.HalfSize(); 
+	obb.axis[0] = float3::unitX; 
+	obb.axis[1] = float3::unitY;
+	obb.axis[2] = float3::unitZ;
+	Push(obb); 
+}
+
+void CullBoxes::Clear()
+{
+	posX.clear(); posY.clear(); posZ.clear(); 
+	rX.clear(); rY.clear(); rZ.clear();
+	for (auto& a : axis)
+		a.clear(); 
+}
+
+// ----------------------------------------------------------------- [Kernels]
+uint FrustrumCuller::Cull(const CullPlanes& planes, const CullBoxes& boxes, uint* visible)
+{
+#if defined(CULL_AVX)
+	return CullAVX(planes, boxes, visible); 
+#elif defined(CULL_SSE)
+	return CullSSE(planes, boxes, visible);
+#else
+	return CullScalar(planes, boxes, visible);
+#endif
+}
+
+// Also finishes the tail the wide kernels leave (from "first" on)
+uint FrustrumCuller::CullScalar(const CullPlanes& planes, const CullBoxes& boxes, uint* visible, uint first)
+{
+	uint count = 0; 
+	uint size = boxes.Size(); 
+
+	for (uint b = first; b < size; ++b)
+	{
+		bool out = false; 
+		for (uint p = 0; p < 6 && out == false; ++p)
+		{
+			float dist = planes.nX[p] * boxes.posX[b] + planes.nY[p] * boxes.posY[b] + planes.nZ[p] * boxes.posZ[b] + planes.d[p]; 
+			float r0 = std::abs(planes.nX[p] * boxes.axis[0][b] + planes.nY[p] * boxes.axis[1][b] + planes.nZ[p] * boxes.axis[2][b]) * boxes.rX[b];
+			float r1 = std::abs(planes.nX[p] * boxes.axis[3][b] + planes.nY[p] * boxes.axis[4][b] + planes.nZ[p] * boxes.axis[5][b]) * boxes.rY[b];
+			float r2 = std::abs(planes.nX[p] * boxes.axis[6][b] + planes.nY[p] * boxes.axis[7][b] + planes.nZ[p] * boxes.axis[8][b]) * boxes.rZ[b];
+			out = (dist + r0 + r1 + r2 < 0); 
+		}
+
+		if (out == false)
+			visible[count++] = b; 
+	}
+
+	return count; 
+}
+
+#ifdef CULL_SSE
+uint FrustrumCuller::CullSSE(const CullPlanes& planes, const CullBoxes& boxes, uint* visible)
+{
+	uint count = 0; 
+	uint size = boxes.Size(); 
+	uint wide = size & ~3u; 
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)); // abs() = clear the sign bit 
+	const __m128 zero = _mm_setzero_ps(); 
+
+	for (uint b = 0; b < wide; b += 4)
+	{
+		__m128 pX = _mm_loadu_ps(&boxes.posX[b]), pY = _mm_loadu_ps(&boxes.posY[b]), pZ = _mm_loadu_ps(&boxes.posZ[b]);
+		__m128 rX = _mm_loadu_ps(&boxes.rX[b]), rY = _mm_loadu_ps(&boxes.rY[b]), rZ = _mm_loadu_ps(&boxes.rZ[b]);
+		__m128 a[9]; 
+		for (uint i = 0; i < 9; ++i)
+			a[i] = _mm_loadu_ps(&boxes.axis[i][b]); 
+
+		__m128 out = _mm_setzero_ps(); 
+		for (uint p = 0; p < 6; ++p)
+		{
+			__m128 nX = _mm_set1_ps(planes.nX[p]), nY = _mm_set1_ps(planes.nY[p]), nZ = _mm_set1_ps(planes.nZ[p]);
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, pX), _mm_mul_ps(nY, pY)), _mm_add_ps(_mm_mul_ps(nZ, pZ), _mm_set1_ps(planes.d[p])));
+			__m128 r0 = _mm_and_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, a[0]), _mm_mul_ps(nY, a[1])), _mm_mul_ps(nZ, a[2])), signMask);
+			__m128 r1 = _mm_and_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, a[3]), _mm_mul_ps(nY, a[4])), _mm_mul_ps(nZ, a[5])), signMask);
+			__m128 r2 = _mm_and_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, a[6]), _mm_mul_ps(nY, a[7])), _mm_mul_ps(nZ, a[8])), signMask);
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, rX), _mm_mul_ps(r1, rY)), _mm_mul_ps(r2, rZ));
+			out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(dist, r), zero)); 
+		}
+
+		// compact: one bit per box that is in
+		int in = ~_mm_movemask_ps(out) & 0xF; 
+		while (in)
+		{
+			uint lane = 0; 
+			while ((in & (1 << lane)) == 0)
+				++lane; 
+			visible[count++] = b + lane; 
+			in &= in - 1; 
+		}
+	}
+
+	return count + CullScalar(planes, boxes, visible + count, wide);
+}
+#endif
+
+#ifdef CULL_AVX
+uint FrustrumCuller::CullAVX(const CullPlanes& planes, const CullBoxes& boxes, uint* visible)
+{
+	uint count = 0;
+	uint size = boxes.Size();
+	uint wide = size & ~7u;
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (uint b = 0; b < wide; b += 8)
+	{
+		__m256 pX = _mm256_loadu_ps(&boxes.posX[b]), pY = _mm256_loadu_ps(&boxes.posY[b]), pZ = _mm256_loadu_ps(&boxes.posZ[b]);
+		__m256 rX = _mm256_loadu_ps(&boxes.rX[b]), rY = _mm256_loadu_ps(&boxes.rY[b]), rZ = _mm256_loadu_ps(&boxes.rZ[b]);
+		__m256 a[9];
+		for (uint i = 0; i < 9; ++i)
+			a[i] = _mm256_loadu_ps(&boxes.axis[i][b]);
+
+		__m256 out = _mm256_setzero_ps();
+		for (uint p = 0; p < 6; ++p)
+		{
+			__m256 nX = _mm256_set1_ps(planes.nX[p]), nY = _mm256_set1_ps(planes.nY[p]), nZ = _mm256_set1_ps(planes.nZ[p]);
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, pX), _mm256_mul_ps(nY, pY)), _mm256_add_ps(_mm256_mul_ps(nZ, pZ), _mm256_set1_ps(planes.d[p])));
+			__m256 r0 = _mm256_and_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, a[0]), _mm256_mul_ps(nY, a[1])), _mm256_mul_ps(nZ, a[2])), signMask);
+			__m256 r1 = _mm256_and_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, a[3]), _mm256_mul_ps(nY, a[4])), _mm256_mul_ps(nZ, a[5])), signMask);
+			__m256 r2 = _mm256_and_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, a[6]), _mm256_mul_ps(nY, a[7])), _mm256_mul_ps(nZ, a[8])), signMask);
+			__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r0, rX), _mm256_mul_ps(r1, rY)), _mm256_mul_ps(r2, rZ));
+			out = _mm256_or_ps(out, _mm256_cmp_ps(_mm256_add_ps(dist, r), zero, _CMP_LT_OQ));
+		}
+
+		int in = ~_mm256_movemask_ps(out) & 0xFF;
+		while (in)
+		{
+			uint lane = 0;
+			while ((in & (1 << lane)) == 0)
+				++lane;
+			visible[count++] = b + lane;
+			in &= in - 1;
+		}
+	}
+
+	return count + CullScalar(planes, boxes, visible + count, wide);
+}
+#endif
+
+// ----------------------------------------------------------------- [Benchmark]
+void FrustrumCuller::Benchmark(Frustrum& frustrum, uint boxCount, uint iterations)
+{
+	// random boxes around the frustrum's near plane, same seed every run
+	pcg32 rng(42u); 
+	std::uniform_real_distribution<float> position(-200.f, 200.f), size(0.5f, 10.f), angle(0.f, 6.2831f);
+	float3 center = frustrum.GetPlanes()[0].center; 
+
+	std::vector<math::OBB> obbs(boxCount); 
+	CullBoxes boxes; 
+	for (auto& obb : obbs)
+	{
+		obb.pos = center + float3(position(rng), position(rng), position(rng)); 
+		obb.r = float3(size(rng), size(rng), size(rng)); 
+		float3x3 rot = float3x3::FromEulerXYZ(angle(rng), angle(rng), angle(rng)); 
+		obb.axis[0] = rot.Col(0); 
+		obb.axis[1] = rot.Col(1);
+		obb.axis[2] = rot.Col(2);
+		boxes.Push(obb); 
+	}
+
+	std::vector<uint> visible(boxCount); 
+	CullPlanes planes(frustrum); 
+	auto time = [&](auto kernel, uint& count) -> double 
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint i = 0; i < iterations; ++i)
+			count = kernel(); 
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start; 
+		return elapsed.count() / iterations; 
+	};
+
+	uint count = 0; 
+	double ms = time([&]() { uint c = 0; for (auto& obb : obbs) c += (frustrum.IsBoxInsideFrustrumView(obb) != Frustrum::INTERSECTION_TYPE::OUTSIDE); return c; }, count); 
+	LOG("Culling benchmark (%i boxes): corner test %.3f ms, %i visible", boxCount, ms, count); 
+	ms = time([&]() { return CullScalar(planes, boxes, visible.data()); }, count);
+	LOG("Culling benchmark (%i boxes): scalar %.3f ms, %i visible", boxCount, ms, count);
+#ifdef CULL_SSE
+	ms = time([&]() { return CullSSE(planes, boxes, visible.data()); }, count);
+	LOG("Culling benchmark (%i boxes): SSE %.3f ms, %i visible", boxCount, ms, count);
+#endif
+#ifdef CULL_AVX
+	ms = time([&]() { return CullAVX(planes, boxes, visible.data()); }, count);
+	LOG("Culling benchmark (%i boxes): AVX %.3f ms, %i visible", boxCount, ms, count);
+#endif
+}
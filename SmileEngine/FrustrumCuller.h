@@ -0,0 +1,57 @@
+#pragma once
+
+#include "SmileSetup.h"
+#include "MathGeoLib/include/Math/float3.h"
+#include "MathGeoLib/include/Geometry/OBB.h"
+#include "MathGeoLib/include/Geometry/AABB.h"
+#include <vector>
+
+// SSE2 is on by default in 32 bit MSVC builds (/arch:SSE2), AVX needs /arch:AVX 
+#if defined(__AVX__)
+#define CULL_AVX
+#endif
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_SSE
+#endif
+
+class Frustrum; 
+// ----------------------------------------------------------------- [CullPlanes]
+// The 6 frustrum planes as n.p + d >= 0 (inside), normals normalized and pointing inwards
+struct CullPlanes
+{
+	float nX[6], nY[6], nZ[6], d[6];
+	CullPlanes(const Frustrum& frustrum); 
+};
+
+// ----------------------------------------------------------------- [CullBoxes]
+// Boxes as structure of arrays: center, half size (extents) and the 3 axes. AABBs just have the world axes
+struct CullBoxes
+{
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rX, rY, rZ;
+	std::vector<float> axis[9]; // axis[i * 3 + j] = component j of axis i
+
+	void Push(const math::OBB& box); 
+	void Push(const math::AABB& box); 
+	void Clear(); 
+	uint Size() const { return posX.size(); };
+};
+
+// ----------------------------------------------------------------- [FrustrumCuller]
+// Batch center-extent tests: a box is out if it is behind any plane -> n.c + d + |n.a0| r0 + |n.a1| r1 + |n.a2| r2 < 0 
+// "visible" gets the indices of the boxes that are not out, compacted. It must have room for all boxes. Returns the count
+class FrustrumCuller
+{
+public:
+	static uint Cull(const CullPlanes& planes, const CullBoxes& boxes, uint* visible); // the widest available
+	static uint CullScalar(const CullPlanes& planes, const CullBoxes& boxes, uint* visible, uint first = 0);
+#ifdef CULL_SSE
+	static uint CullSSE(const CullPlanes& planes, const CullBoxes& boxes, uint* visible); // 4 boxes at once
+#endif
+#ifdef CULL_AVX
+	static uint CullAVX(const CullPlanes& planes, const CullBoxes& boxes, uint* visible); // 8 boxes at once
+#endif
+
+	// Times the old per-corner OBB test against the batch kernels with "boxCount" random boxes, and logs it 
+	static void Benchmark(Frustrum& frustrum, uint boxCount = 10000, uint iterations = 20); 
+};
@@ -182,8 +182,7 @@ void GameObject::Update(float dt)
 void GameObject::CleanUp()
 {
 	// 0) Remove from octree!!!!
-	if (isStatic)
-		App->spatial_tree->OnStaticChange(this, false); 
+	App->spatial_tree->RemoveObject(this); 
 
 
 	// 1) Components 
@@ -271,6 +270,9 @@ void GameObject::OnTransform(bool updateBounding) // called when the Transform s
 	if(updateBounding)
 		UpdateBounding();
 
+	// The octree may need to move me to another node
+	App->spatial_tree->OnObjectMoved(this); 
+
 	// Update components if they need so (like camera)
 	for (auto& comp : components)
 		if (comp)
@@ -411,6 +413,12 @@ void GameObject::ResizeBounding(float size)
 	boundingData.AABB.Enclose(boundingData.OBB);
 }
 
+void GameObject::SetBounding(const math::AABB& box)
+{
+	boundingData.AABB = box;
+	boundingData.OBB.SetFrom(box);
+}
+
 void GameObject::UpdateBounding()
 {
 	float4x4 transfGlobalMat = GetTransform()->GetGlobalMatrix();
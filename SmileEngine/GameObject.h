@@ -85,7 +85,6 @@ public:
 	virtual void Start(); 
 	virtual void Enable(); 
 	virtual void Update(float dt);
-	void PostUpdate() { toDraw = false; for (auto& child : childObjects) child->PostUpdate(); };
 	void Draw(); 
 	virtual void Disable();
 	virtual void CleanUp(); 
@@ -101,6 +100,7 @@ public:
 	void SetupBounding();  
 	void UpdateBounding();
 	void ResizeBounding(float size); 
+	void SetBounding(const math::AABB& box); // world, as it is (e.g. an emitter's particles)
 
 		// Static stuff
 	void SetStatic(bool isStatic); 
@@ -110,7 +110,6 @@ public:
 	std::vector<GameObject*> childObjects;
 	DebugData debugData; 
 	uint randomID;
-	bool toDraw = false;
 private: 
 
 	std::array<Component*, COMPONENT_TYPE::MAX_COMPONENT_TYPES> components; // each component type has either one element or a vector 
@@ -126,6 +125,12 @@ private:
 	// may have one of these
 	FreeBillBoard* billboard = nullptr; 
 
+	// my handle in the octree, if it keeps me
+	uint spatialHandle = UINT_MAX; 
+
 	friend class SmileGameObjectManager; 
 	friend class ComponentCamera; 
+	friend class SmileSpatialTree; 
+	friend class Octree; 
+	friend class BVH; 
 };
\ No newline at end of file
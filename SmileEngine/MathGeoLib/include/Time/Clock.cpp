@@ -164,7 +164,7 @@ int Clock::Hour()
 #endif
 }
 
-int Clock::Min()
+/*int Clock::Min()
 {
 #ifdef WIN32
 	SYSTEMTIME s;
@@ -174,7 +174,7 @@ int Clock::Min()
 	///\todo.
 	return 0;
 #endif
-}
+}*/
 
 int Clock::Sec()
 {
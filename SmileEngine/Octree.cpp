@@ -0,0 +1,1422 @@
+#include "Octree.h"
+#include "GameObject.h"
+#include "Component.h"
+#include "ComponentCamera.h"
+#include "OctreeTuner.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cfloat>
+
+Octree::Octree(math::AABB aabb, uint depth, uint maxNodeObjects, float looseness)
+	: maxDepth(depth), baseMaxDepth(depth), maxNodeObjects(maxNodeObjects), looseness(looseness)
+{
+	// the root is to be created once
+	nodes.push_back(OctreeNode()); 
+	bounds.Push(aabb.CenterPoint(), aabb.HalfSize()); 
+}
+
+Octree::~Octree()
+{
+	Clear(); 
+}
+
+void Octree::Insert(GameObject* obj)
+{
+	InsertBatch({ obj }); 
+}
+
+// Keeps the root (and its bounds), everything else goes. The vectors keep their memory for the next build
+void Octree::Clear()
+{
+	for (auto& obj : objects)
+		if (obj)
+			obj->spatialHandle = OCTREE_NONE; 
+
+	objects.clear(); 
+	objectFirstRef.clear(); 
+	freeHandles.clear(); 
+	objectRefs.clear(); 
+	refLinks.clear(); 
+	refPool.clear(); 
+	freeRef = OCTREE_NONE; 
+	freeBuckets.clear(); 
+
+	nodes.resize(1); 
+	nodes[0] = OctreeNode(); 
+	bounds.Resize(1); 
+	freeOctets.clear(); 
+	rebalanceCursor = 0; 
+}
+
+void Octree::Remove(GameObject* obj)
+{
+	uint handle = obj->spatialHandle; 
+	if (handle == OCTREE_NONE)
+		return; 
+
+	DeleteObject(handle); 
+	ReleaseHandle(handle); 
+}
+
+// Called when an object's bounding changes. A loose tree keeps the object in one node, so moving it is a climb to the
+// first node that can hold it, and a descent from there -> O(depth), no full remove and reinsert. A classic tree keeps
+// it in every node it intersects: it leaves them all and goes in again from the root
+void Octree::OnObjectMoved(GameObject* obj)
+{
+	uint handle = obj->spatialHandle; 
+	if (handle == OCTREE_NONE)
+		return; 
+
+	math::AABB box = obj->GetBoundingData().AABB;
+	if (IsLoose() == false)
+	{
+		DeleteObject(handle); 
+		GrowToFit(box); 
+		InsertObject(0, handle); 
+		return; 
+	}
+
+	uint node = GetObjectNode(handle); 
+
+	// A) The node still holds it and no child could take it: nothing to do
+	if (LooseContains(node, box) && (nodes[node].IsLeaf() 
+		|| LooseContains(nodes[node].firstChild + GetChildIndex(node, box.CenterPoint()), box) == false))
+		return; 
+
+	// B) Climb, then sink. Out of the root: grow it
+	DeleteObject(handle); 
+	while (nodes[node].parent != OCTREE_NONE && LooseContains(node, box) == false)
+		node = nodes[node].parent; 
+
+	if (node == 0 && LooseContains(0, box) == false)
+		GrowToFit(box); 
+
+	InsertObjectLoose(node, handle); 
+}
+
+void Octree::SetLooseness(float looseness, GameObject* root)
+{
+	Clear(); 
+	this->looseness = looseness; 
+	Insert(root); 
+}
+
+// An empty tree just keeps them for the first build
+void Octree::SetParameters(uint maxDepth, uint maxNodeObjects, GameObject* root)
+{
+	bool rebuild = GetObjectCount() > 0; 
+	Clear(); 
+	this->maxDepth = baseMaxDepth = maxDepth; 
+	this->maxNodeObjects = maxNodeObjects; 
+	if (rebuild)
+		Insert(root); 
+}
+
+// ----------------------------------------------------------------- [Root]
+bool Octree::Takes(GameObject* obj) const
+{
+	return obj->GetStatic() == true || IsLoose() == true; 
+}
+
+// The cube around the box: the octants stay cubes too
+static math::AABB FitCube(const math::AABB& box)
+{
+	float3 half = box.HalfSize(); 
+	float size = Max(Max(half.x, half.y), Max(half.z, OCTREE_MIN_ROOT_HALF_SIZE)) * 1.01f; 
+	return math::AABB(box.CenterPoint() - float3(size, size, size), box.CenterPoint() + float3(size, size, size)); 
+}
+
+// The root becomes the cube around the objects
+void Octree::FitRoot(const std::vector<GameObject*>& objs)
+{
+	math::AABB box; 
+	box.SetNegativeInfinity(); 
+	for (auto& obj : objs)
+		if (obj->GetBoundingData().AABB.IsFinite())
+			box.Enclose(obj->GetBoundingData().AABB); 
+	if (box.IsFinite() == false)
+		return; 
+
+	Clear(); 
+	maxDepth = baseMaxDepth; 
+	math::AABB cube = FitCube(box); 
+	bounds.Resize(0); 
+	bounds.Push(cube.CenterPoint(), cube.HalfSize()); 
+}
+
+bool Octree::RootContains(const math::AABB& box) const
+{
+	return (IsLoose()) ? LooseContains(0, box) : GetNodeAABB(0).Contains(box); 
+}
+
+void Octree::GrowToFit(const math::AABB& box)
+{
+	if (box.IsFinite() == false)
+		return; 
+
+	for (uint i = 0; i < OCTREE_MAX_ROOT_GROWTH && RootContains(box) == false; ++i)
+		Reroot(box.CenterPoint()); 
+}
+
+// The root doubles its size towards the point: a new root is created, and the old one becomes one of its children.
+// The old root's objects that were out of it (stranded) are inserted again from the new root
+void Octree::Reroot(const float3& towards)
+{
+	float3 center(bounds.centerX[0], bounds.centerY[0], bounds.centerZ[0]); 
+	float3 half(bounds.halfX[0], bounds.halfY[0], bounds.halfZ[0]); 
+	float3 newCenter(center.x + ((towards.x > center.x) ? half.x : -half.x), center.y + ((towards.y > center.y) ? half.y : -half.y),
+		center.z + ((towards.z > center.z) ? half.z : -half.z)); 
+	uint octant = (uint)(towards.x <= center.x) | ((uint)(towards.y <= center.y) << 1) | ((uint)(towards.z <= center.z) << 2); 
+
+	// A) The rest of the tree goes a level down
+	for (uint node = 1; node < nodes.size(); ++node)
+		nodes[node].depth++; 
+	maxDepth++; 
+
+	// B) The 8 children of the new root, one of them takes the old root's place
+	uint firstChild = AllocateOctet(0, 1); 
+	for (uint i = 0; i < 8; ++i)
+	{
+		float3 offset((i & 1) ? half.x : -half.x, (i & 2) ? half.y : -half.y, (i & 4) ? half.z : -half.z);
+		bounds.Set(firstChild + i, newCenter + offset, half);
+	}
+
+	uint oldRoot = firstChild + octant; 
+	nodes[oldRoot] = nodes[0]; 
+	nodes[oldRoot].parent = 0; 
+	nodes[oldRoot].depth = 1; 
+	if (nodes[oldRoot].IsLeaf() == false)
+		for (uint i = 0; i < 8; ++i)
+			nodes[nodes[oldRoot].firstChild + i].parent = oldRoot; 
+
+	for (uint i = nodes[oldRoot].objFirst; i < nodes[oldRoot].objFirst + nodes[oldRoot].objCount; ++i)
+		refPool[refLinks[i]].node = oldRoot; 
+
+	nodes[0] = OctreeNode(); 
+	nodes[0].firstChild = firstChild; 
+	bounds.centerX[0] = newCenter.x; 
+	bounds.centerY[0] = newCenter.y;
+	bounds.centerZ[0] = newCenter.z;
+	bounds.halfX[0] = half.x * 2.f; 
+	bounds.halfY[0] = half.y * 2.f;
+	bounds.halfZ[0] = half.z * 2.f;
+
+	// C) The old root's objects: the ones that fit stay, the stranded ones go again from the top 
+	std::vector<uint> stranded; 
+	for (uint i = 0; i < nodes[oldRoot].objCount;)
+	{
+		uint handle = objectRefs[nodes[oldRoot].objFirst + i]; 
+		math::AABB box = objects[handle]->GetBoundingData().AABB; 
+		bool fits = (IsLoose()) ? LooseContains(oldRoot, box) : GetNodeAABB(oldRoot).Contains(box); 
+		if (fits)
+		{
+			++i; 
+			continue; 
+		}
+
+		RemoveFromNodeAt(oldRoot, i); 
+		stranded.push_back(handle); 
+	}
+
+	for (auto& handle : stranded)
+	{
+		if (IsLoose())
+			InsertObjectLoose(0, handle);
+		else
+			InsertObject(0, handle); 
+	}
+}
+
+uint Octree::GetStrandedCount() const
+{
+	uint ret = 0; 
+	const OctreeNode& root = nodes[0]; 
+	for (uint i = root.objFirst; i < root.objFirst + root.objCount; ++i)
+	{
+		math::AABB box = objects[objectRefs[i]]->GetBoundingData().AABB; 
+		ret += (IsLoose()) ? (LooseContains(0, box) == false) : (GetNodeAABB(0).Intersects(box) == false); 
+	}
+
+	return ret; 
+}
+
+// ----------------------------------------------------------------- [Bulk build]
+// Objects are sorted by the Morton code of their center, so the ones under any node are a contiguous range, and
+// each child's are a sub-range. The top levels are built here, the subtrees below OCTREE_BULK_TASK_DEPTH on all cores
+#define MORTON_LEVELS 10 // bits per axis in a code
+
+struct OctreeBulkItem
+{
+	uint code; 
+	uint handle; 
+};
+
+// A built piece of tree, before it goes into the pool: object refs relative to "refs", children relative to "nodes"
+struct OctreeBulkOutput
+{
+	std::vector<OctreeNode> nodes; 
+	std::vector<float3> centers, halves; 
+	std::vector<uint> refs; 
+	std::vector<std::array<uint, 3>> tasks; // node, first, count: left to be built on their own
+};
+
+struct OctreeBulkContext
+{
+	const std::vector<math::AABB>& boxes; // by handle
+	std::vector<OctreeBulkItem>& items; 
+	float looseness; 
+	uint maxDepth, maxNodeObjects, taskDepth; 
+};
+
+static uint MortonSpread(uint v) // 10 bits, to every third bit
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v; 
+}
+
+static uint MortonCode(const math::AABB& box, const float3& rootMin, const float3& rootSize)
+{
+	if (box.IsFinite() == false)
+		return 0; 
+
+	float3 cell = (box.CenterPoint() - rootMin).Div(rootSize) * (float)(1 << MORTON_LEVELS); 
+	uint x = (uint)Clamp(cell.x, 0.f, (float)((1 << MORTON_LEVELS) - 1)); 
+	uint y = (uint)Clamp(cell.y, 0.f, (float)((1 << MORTON_LEVELS) - 1));
+	uint z = (uint)Clamp(cell.z, 0.f, (float)((1 << MORTON_LEVELS) - 1));
+	return MortonSpread(x) | (MortonSpread(y) << 1) | (MortonSpread(z) << 2); // same octant order as the children
+}
+
+// 4 passes of 8 bits
+static void RadixSort(std::vector<OctreeBulkItem>& items)
+{
+	std::vector<OctreeBulkItem> temp(items.size()); 
+	for (uint shift = 0; shift < 32; shift += 8)
+	{
+		uint offsets[257] = { 0 }; 
+		for (auto& item : items)
+			offsets[((item.code >> shift) & 0xFF) + 1]++; 
+		for (uint i = 1; i < 257; ++i)
+			offsets[i] += offsets[i - 1]; 
+		for (auto& item : items)
+			temp[offsets[(item.code >> shift) & 0xFF]++] = item; 
+		items.swap(temp); 
+	}
+}
+
+static bool BulkFits(const float3& center, const float3& half, const math::AABB& box)
+{
+	return box.minPoint.x >= center.x - half.x && box.maxPoint.x <= center.x + half.x
+		&& box.minPoint.y >= center.y - half.y && box.maxPoint.y <= center.y + half.y
+		&& box.minPoint.z >= center.z - half.z && box.maxPoint.z <= center.z + half.z;
+}
+
+static void BulkKeep(OctreeBulkOutput& out, uint node, const std::vector<OctreeBulkItem>& items, uint first, uint count)
+{
+	out.nodes[node].objFirst = out.refs.size(); 
+	out.nodes[node].objCount = count; 
+	for (uint i = first; i < first + count; ++i)
+		out.refs.push_back(items[i].handle); 
+}
+
+// Same rules as inserting one by one: a node splits when it has too many objects, and an object goes down to
+// the child around its center if that child (or its loose bounds) contains it
+static void BulkBuildNode(const OctreeBulkContext& ctx, OctreeBulkOutput& out, uint node, uint first, uint count)
+{
+	uint depth = out.nodes[node].depth; 
+
+	// A) A leaf with all of them
+	if (count <= ctx.maxNodeObjects || depth >= ctx.maxDepth || depth >= MORTON_LEVELS)
+	{
+		BulkKeep(out, node, ctx.items, first, count); 
+		return; 
+	}
+
+	// B) Deep enough to be built on its own
+	if (depth == ctx.taskDepth)
+	{
+		out.tasks.push_back({ node, first, count }); 
+		return; 
+	}
+
+	// C) Split
+	uint firstChild = out.nodes.size(); 
+	float3 center = out.centers[node], half = out.halves[node] * 0.5f;
+	for (uint i = 0; i < 8; ++i)
+	{
+		OctreeNode child; 
+		child.parent = node; 
+		child.depth = depth + 1; 
+		out.nodes.push_back(child); 
+		out.centers.push_back(center + float3((i & 1) ? half.x : -half.x, (i & 2) ? half.y : -half.y, (i & 4) ? half.z : -half.z)); 
+		out.halves.push_back(half); 
+	}
+	out.nodes[node].firstChild = firstChild; 
+
+	// each child's range: the ones it can not hold are moved to the front (they stay with me), the rest keep their order
+	uint shift = 3 * (MORTON_LEVELS - 1 - depth); 
+	uint childFirst[8], childCount[8]; 
+	std::vector<uint> stay; 
+	uint i = first; 
+	for (uint c = 0; c < 8; ++c)
+	{
+		uint begin = i; 
+		while (i < first + count && ((ctx.items[i].code >> shift) & 7) == c)
+			++i; 
+
+		float3 childHalf = out.halves[firstChild + c] * ctx.looseness; 
+		auto goes = std::stable_partition(ctx.items.begin() + begin, ctx.items.begin() + i, 
+			[&](const OctreeBulkItem& item) { return BulkFits(out.centers[firstChild + c], childHalf, ctx.boxes[item.handle]) == false; });
+		for (auto it = ctx.items.begin() + begin; it != goes; ++it)
+			stay.push_back(it->handle); 
+
+		childFirst[c] = goes - ctx.items.begin(); 
+		childCount[c] = i - childFirst[c]; 
+	}
+
+	out.nodes[node].objFirst = out.refs.size(); 
+	out.nodes[node].objCount = stay.size(); 
+	out.refs.insert(out.refs.end(), stay.begin(), stay.end()); 
+
+	for (uint c = 0; c < 8; ++c)
+		BulkBuildNode(ctx, out, firstChild + c, childFirst[c], childCount[c]); 
+}
+
+static void GatherObjectTree(std::vector<GameObject*>& gathered, GameObject* obj, bool staticOnly)
+{
+	if (staticOnly == false || obj->GetStatic())
+		gathered.push_back(obj); 
+
+	for (auto& child : obj->GetImmidiateChildren())
+		GatherObjectTree(gathered, child, staticOnly); 
+}
+
+void Octree::BulkBuild(const std::vector<GameObject*>& gathered)
+{
+	// 1) Objects, their boxes and codes
+	std::vector<OctreeBulkItem> items; 
+	std::vector<math::AABB> boxes; 
+	items.reserve(gathered.size()); 
+	math::AABB root = GetNodeAABB(0); 
+	for (auto& gameObject : gathered)
+	{
+		if (gameObject->spatialHandle != OCTREE_NONE)
+			continue; 
+
+		uint handle = AcquireHandle(gameObject); 
+		if (boxes.size() <= handle)
+			boxes.resize(handle + 1); 
+		boxes[handle] = gameObject->GetBoundingData().AABB; 
+		items.push_back({ MortonCode(boxes[handle], root.minPoint, root.Size()), handle }); 
+	}
+
+	// 2) Sort them 
+	RadixSort(items); 
+
+	// 3) The top of the tree
+	OctreeBulkContext ctx = { boxes, items, looseness, maxDepth, maxNodeObjects, 
+		(items.size() >= OCTREE_BULK_MIN_PARALLEL) ? OCTREE_BULK_TASK_DEPTH : UINT_MAX }; 
+	OctreeBulkOutput top; 
+	top.nodes.push_back(OctreeNode()); 
+	top.centers.push_back(root.CenterPoint()); 
+	top.halves.push_back(root.HalfSize()); 
+	BulkBuildNode(ctx, top, 0, 0, items.size()); 
+
+	// 4) The subtrees, in parallel (each one has its own range of items)
+	std::vector<OctreeBulkOutput> subtrees(top.tasks.size()); 
+	std::atomic<uint> next = 0; 
+	auto worker = [&]()
+	{
+		OctreeBulkContext taskCtx = ctx; 
+		taskCtx.taskDepth = UINT_MAX; 
+		for (uint t = next++; t < subtrees.size(); t = next++)
+		{
+			uint node = top.tasks[t][0]; 
+			OctreeNode taskRoot; 
+			taskRoot.depth = top.nodes[node].depth; 
+			subtrees[t].nodes.push_back(taskRoot); 
+			subtrees[t].centers.push_back(top.centers[node]); 
+			subtrees[t].halves.push_back(top.halves[node]); 
+			BulkBuildNode(taskCtx, subtrees[t], 0, top.tasks[t][1], top.tasks[t][2]); 
+		}
+	}; 
+
+	std::vector<std::thread> threads; 
+	uint threadCount = Min((uint)subtrees.size(), Max(std::thread::hardware_concurrency(), 1u)); 
+	for (uint i = 1; i < threadCount; ++i)
+		threads.emplace_back(worker); 
+	worker(); 
+	for (auto& thread : threads)
+		thread.join(); 
+
+	// 5) All into the pool
+	nodes.clear(); 
+	bounds.Clear(); 
+	freeOctets.clear(); 
+	objectRefs.clear(); 
+	refLinks.clear(); 
+	refPool.clear(); 
+	freeRef = OCTREE_NONE; 
+	freeBuckets.clear(); 
+	SpliceBulk(top, OCTREE_NONE); 
+	for (uint t = 0; t < subtrees.size(); ++t)
+		SpliceBulk(subtrees[t], top.tasks[t][0]); 
+}
+
+// "root" is the pool node the output's first node is (none: it is appended like the rest)
+void Octree::SpliceBulk(const OctreeBulkOutput& out, uint root)
+{
+	uint base = nodes.size(); 
+	auto ToPool = [&](uint local) -> uint
+	{
+		if (local == OCTREE_NONE)
+			return OCTREE_NONE; 
+		if (root == OCTREE_NONE)
+			return base + local; 
+		return (local == 0) ? root : base + local - 1; 
+	}; 
+
+	for (uint local = 0; local < out.nodes.size(); ++local)
+	{
+		uint node = ToPool(local); 
+		if (root == OCTREE_NONE || local != 0) // a new one (appended in order)
+		{
+			OctreeNode fresh; 
+			fresh.parent = ToPool(out.nodes[local].parent); 
+			fresh.depth = out.nodes[local].depth; 
+			nodes.push_back(fresh); 
+			bounds.Push(out.centers[local], out.halves[local]); 
+		}
+
+		nodes[node].firstChild = ToPool(out.nodes[local].firstChild); 
+
+		uint count = out.nodes[local].objCount; 
+		if (count == 0)
+			continue; 
+
+		// a bucket of a size class, so it can be grown and freed like any other
+		uint capacity = OCTREE_MIN_BUCKET; 
+		while (capacity < count)
+			capacity <<= 1; 
+		uint first = AllocateBucket(capacity); 
+		std::copy(out.refs.begin() + out.nodes[local].objFirst, out.refs.begin() + out.nodes[local].objFirst + count, objectRefs.begin() + first); 
+		nodes[node].objFirst = first; 
+		nodes[node].objCount = count; 
+		nodes[node].objCapacity = capacity; 
+
+		for (uint i = 0; i < count; ++i)
+			LinkRef(objectRefs[first + i], node, i); 
+	}
+}
+
+// ----------------------------------------------------------------- [Insertion]
+// Each object comes with its children. An empty tree fits its root to them, and builds in one go (scene load, 
+// rebuilds). Otherwise the root grows once for all of them, and they go in along the Morton curve: one after another,
+// they walk down the same nodes
+void Octree::InsertBatch(const std::vector<GameObject*>& objs)
+{
+	// a loose tree takes static and non-static objects. Either way, only once
+	std::vector<GameObject*> gathered; 
+	for (auto& obj : objs)
+		GatherObjectTree(gathered, obj, IsLoose() == false); 
+
+	if (GetObjectCount() == 0)
+	{
+		FitRoot(gathered); 
+		BulkBuild(gathered); 
+		return; 
+	}
+
+	math::AABB box; 
+	box.SetNegativeInfinity(); 
+	for (auto& obj : gathered)
+		if (obj->spatialHandle == OCTREE_NONE && obj->GetBoundingData().AABB.IsFinite())
+			box.Enclose(obj->GetBoundingData().AABB); 
+	GrowToFit(box); 
+
+	// (the "handle" of the sort items is the index in "gathered")
+	math::AABB root = GetNodeAABB(0); 
+	std::vector<OctreeBulkItem> items; 
+	items.reserve(gathered.size()); 
+	for (uint i = 0; i < gathered.size(); ++i)
+		items.push_back({ MortonCode(gathered[i]->GetBoundingData().AABB, root.minPoint, root.Size()), i }); 
+	RadixSort(items); 
+
+	for (auto& item : items)
+	{
+		GameObject* obj = gathered[item.handle]; 
+		if (obj->spatialHandle != OCTREE_NONE) // wohoa! 
+			continue; 
+
+		if (IsLoose())
+			InsertObjectLoose(0, AcquireHandle(obj));
+		else
+			InsertObject(0, AcquireHandle(obj));
+	}
+}
+
+void Octree::InsertObject(uint node, uint handle)
+{
+	// A) I have child nodes, then pass the object directly to them (conditions) 
+	if (nodes[node].IsLeaf() == false)
+	{
+		if (SendObjectToChildren(node, handle) == false) 
+			AddToNode(node, handle); 
+		return; 
+	}
+
+	// B) I do not have child nodes right now
+	// if I have the maximum objects, but splitting means exceeding the max tree depth, rather keep the object for myself
+	// If I have less than the maximum objects, push it directly
+	if (nodes[node].depth >= maxDepth || nodes[node].objCount < maxNodeObjects)
+	{
+		AddToNode(node, handle); 
+		return; 
+	}
+
+	// If I have the maximum objects, split and rearrange objects
+	Split(node);
+	AddToNode(node, handle); 
+	RearrangeObjectsInChildren(node);
+}
+
+void Octree::InsertObjectLoose(uint node, uint handle)
+{
+	math::AABB box = objects[handle]->GetBoundingData().AABB; 
+
+	// A) I have child nodes, then pass the object to the one around its center, if its loose bounds can hold it
+	if (nodes[node].IsLeaf() == false)
+	{
+		uint child = nodes[node].firstChild + GetChildIndex(node, box.CenterPoint()); 
+		if (LooseContains(child, box))
+		{
+			InsertObjectLoose(child, handle); 
+			return; 
+		}
+	}
+
+	AddToNode(node, handle); 
+
+	// B) I am a leaf with too many objects, split and let the ones that fit go down
+	if (nodes[node].IsLeaf() && nodes[node].objCount > maxNodeObjects && nodes[node].depth < maxDepth)
+	{
+		Split(node); 
+		RearrangeObjectsLoose(node); 
+	}
+}
+
+// The 8 children are stored together
+void Octree::Split(uint node)
+{
+	uint firstChild = AllocateOctet(node, nodes[node].depth + 1); 
+	float3 center(bounds.centerX[node], bounds.centerY[node], bounds.centerZ[node]); 
+	float3 half(bounds.halfX[node] * 0.5f, bounds.halfY[node] * 0.5f, bounds.halfZ[node] * 0.5f); 
+
+	for (uint i = 0; i < 8; ++i)
+	{
+		float3 offset((i & 1) ? half.x : -half.x, (i & 2) ? half.y : -half.y, (i & 4) ? half.z : -half.z); 
+		bounds.Set(firstChild + i, center + offset, half); 
+	}
+
+	nodes[node].firstChild = firstChild; 
+}
+
+// A collapsed node's octet if there is one, or a new one at the end of the pool
+uint Octree::AllocateOctet(uint parent, uint depth)
+{
+	uint firstChild = nodes.size(); 
+	if (freeOctets.empty() == false)
+	{
+		firstChild = freeOctets.back(); 
+		freeOctets.pop_back(); 
+	}
+	else
+	{
+		nodes.resize(firstChild + 8); 
+		bounds.Resize(firstChild + 8); 
+	}
+
+	for (uint i = firstChild; i < firstChild + 8; ++i)
+	{
+		nodes[i] = OctreeNode(); 
+		nodes[i].parent = parent; 
+		nodes[i].depth = depth; 
+		nodeHits.Take(i); // from the collapsed node's time
+	}
+
+	return firstChild; 
+}
+ 
+// Push the object to children that can encompass it  
+bool Octree::SendObjectToChildren(uint node, uint handle)
+{
+	uint success = 0; 
+	uint firstChild = nodes[node].firstChild; 
+	math::AABB box = objects[handle]->GetBoundingData().AABB; 
+
+	for (uint i = 0; i < 8; ++i)
+	{
+		if (GetNodeAABB(firstChild + i).Intersects(box))
+		{
+			success++; 
+			InsertObject(firstChild + i, handle); 
+		}
+	}
+	
+	// If the object has been pushed to any of the child nodes, return true
+	return (success > 0); 
+}
+
+
+// Takes all the objects and erases the ones that intersect with a child, while pushing it to the child's list
+void Octree::RearrangeObjectsInChildren(uint node)
+{
+	uint firstChild = nodes[node].firstChild; 
+
+	for (uint i = 0; i < nodes[node].objCount;)
+	{
+		uint handle = objectRefs[nodes[node].objFirst + i]; 
+		math::AABB box = objects[handle]->GetBoundingData().AABB; 
+
+		bool intersections[8]; 
+		uint intersectionCount = 0; 
+		for (uint j = 0; j < 8; ++j)
+			intersectionCount += (intersections[j] = GetNodeAABB(firstChild + j).Intersects(box)); 
+
+		// if the object intersects with all 8 child nodes, it'd be a waste to push it to all 8 nodes 
+		// (and if it intersects with none, it is outside me: keep it too)
+		if (intersectionCount == 8 || intersectionCount == 0)
+		{
+			++i; 
+			continue; 
+		}
+			
+		// otherwise erase it from the Node, and push it to all the intersecting children
+		RemoveFromNodeAt(node, i); 
+		for (uint j = 0; j < 8; ++j)
+			if (intersections[j] == true)
+				InsertObject(firstChild + j, handle);
+	}
+}
+
+// Each object goes to the child around its center if it fits there, or stays with me 
+void Octree::RearrangeObjectsLoose(uint node)
+{
+	for (uint i = 0; i < nodes[node].objCount;)
+	{
+		uint handle = objectRefs[nodes[node].objFirst + i];
+		math::AABB box = objects[handle]->GetBoundingData().AABB; 
+		uint child = nodes[node].firstChild + GetChildIndex(node, box.CenterPoint()); 
+
+		if (LooseContains(child, box))
+		{
+			RemoveFromNodeAt(node, i); 
+			InsertObjectLoose(child, handle); 
+		}
+		else
+			++i; 
+	}
+}
+
+// ----------------------------------------------------------------- [Removal]
+// A classic tree may keep the object in more than one node: its back-references say which (and where in them)
+void Octree::DeleteObject(uint handle)
+{
+	while (objectFirstRef[handle] != OCTREE_NONE)
+	{
+		const OctreeObjectRef& ref = refPool[objectFirstRef[handle]]; 
+		RemoveFromNodeAt(ref.node, ref.slot); 
+	}
+}
+
+// ----------------------------------------------------------------- [Rebalancing]
+// Nodes split as objects come in, but nothing undoes it as they leave (or move, in a loose tree). So a slice of the tree
+// is looked at each frame: octets of leaves with few objects go back to their parent, and leaves that are full or that
+// queries test a lot are split
+void Octree::Update(float dt)
+{
+	if (rebalancing)
+		Rebalance(OCTREE_REBALANCE_SLICE); 
+}
+
+void Octree::Rebalance(uint budget)
+{
+	if (nodeHits.GetSize() < nodes.size())
+		nodeHits.Resize(nodes.size()); 
+
+	// once a frame at most for each node, so the hit rates hold
+	sweepFrames++; 
+	budget = Min(budget, (uint)nodes.size()); 
+	for (uint i = 0; i < budget; ++i)
+	{
+		if (rebalanceCursor >= nodes.size())
+		{
+			rebalanceCursor = 0; 
+			lastSweepFrames = sweepFrames; 
+			sweepFrames = 0; 
+		}
+
+		uint node = rebalanceCursor++; 
+		if (IsFree(node) == false)
+			RebalanceNode(node); 
+	}
+}
+
+void Octree::RebalanceNode(uint node)
+{
+	// hits since the node was last looked at, a sweep ago
+	float hitRate = (float)nodeHits.Take(node) / (float)Max(lastSweepFrames, 1u); 
+
+	// A) An octet of leaves with few objects
+	if (nodes[node].IsLeaf() == false)
+	{
+		if (CanCollapse(node))
+		{
+			Collapse(node); 
+			mergeCount++; 
+		}
+		return; 
+	}
+
+	// B) A full leaf (a loose tree lets them fill as objects move in, a grown root allows more depth), or a hot one.
+	// The merge threshold is lower than the hot one, so a split octet is not merged back right away
+	const OctreeNode& n = nodes[node]; 
+	bool hot = hitRate >= OCTREE_HOT_HIT_RATE && n.objCount > maxNodeObjects * OCTREE_HOT_OCCUPANCY; 
+	if (n.depth >= maxDepth || (n.objCount <= maxNodeObjects && hot == false))
+		return; 
+
+	Split(node); 
+	if (IsLoose())
+		RearrangeObjectsLoose(node);
+	else
+		RearrangeObjectsInChildren(node); 
+
+	// none could go down: the children would be empty for nothing. A child that split again took them further down
+	bool moved = false; 
+	for (uint i = 0; i < 8; ++i)
+	{
+		const OctreeNode& child = nodes[nodes[node].firstChild + i]; 
+		moved |= child.IsLeaf() == false || child.objCount > 0; 
+	}
+	if (moved == false)
+		Collapse(node); 
+	else
+		resplitCount++; 
+}
+
+// Duplicates in a classic tree are counted for each node, so it merges a bit less
+bool Octree::CanCollapse(uint node) const
+{
+	uint count = nodes[node].objCount; 
+	for (uint i = 0; i < 8; ++i)
+	{
+		const OctreeNode& child = nodes[nodes[node].firstChild + i]; 
+		if (child.IsLeaf() == false)
+			return false; 
+		count += child.objCount; 
+	}
+
+	return count <= maxNodeObjects * OCTREE_MERGE_OCCUPANCY; 
+}
+
+// The children's objects go to the node, once each (a classic tree may keep one in several children), and their
+// octet is free for the next split. Children's loose bounds are inside the node's, so a loose tree stays right too
+void Octree::Collapse(uint node)
+{
+	uint firstChild = nodes[node].firstChild; 
+	for (uint child = firstChild; child < firstChild + 8; ++child)
+	{
+		while (nodes[child].objCount > 0)
+		{
+			uint slot = nodes[child].objCount - 1; 
+			uint handle = objectRefs[nodes[child].objFirst + slot]; 
+			RemoveFromNodeAt(child, slot); 
+
+			bool kept = false; 
+			for (uint ref = objectFirstRef[handle]; ref != OCTREE_NONE && kept == false; ref = refPool[ref].next)
+				kept = (refPool[ref].node == node); 
+			if (kept == false)
+				AddToNode(node, handle); 
+		}
+
+		FreeBucket(nodes[child].objFirst, nodes[child].objCapacity); 
+		nodes[child] = OctreeNode(); // no parent: free
+	}
+
+	nodes[node].firstChild = OCTREE_NONE; 
+	freeOctets.push_back(firstChild); 
+}
+
+void OctreeHits::Resize(uint size)
+{
+	std::unique_ptr<std::atomic<uint>[]> resized = std::make_unique<std::atomic<uint>[]>(size); 
+	for (uint i = 0; i < Min(size, this->size); ++i)
+		resized[i].store(counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed); 
+
+	counts = std::move(resized); 
+	this->size = size; 
+}
+
+uint OctreeHits::Take(uint node)
+{
+	return (node < size) ? counts[node].exchange(0, std::memory_order_relaxed) : 0; 
+}
+
+// ----------------------------------------------------------------- [Node data]
+math::AABB Octree::GetNodeAABB(uint node) const
+{
+	float3 center(bounds.centerX[node], bounds.centerY[node], bounds.centerZ[node]);
+	float3 half(bounds.halfX[node], bounds.halfY[node], bounds.halfZ[node]);
+	return math::AABB(center - half, center + half); 
+}
+
+math::AABB Octree::GetQueryAABB(uint node) const
+{
+	float3 center(bounds.centerX[node], bounds.centerY[node], bounds.centerZ[node]);
+	float3 half(bounds.halfX[node] * looseness, bounds.halfY[node] * looseness, bounds.halfZ[node] * looseness);
+	return math::AABB(center - half, center + half);
+}
+
+bool Octree::LooseContains(uint node, const math::AABB& box) const
+{
+	float hX = bounds.halfX[node] * looseness, hY = bounds.halfY[node] * looseness, hZ = bounds.halfZ[node] * looseness; 
+	return box.minPoint.x >= bounds.centerX[node] - hX && box.maxPoint.x <= bounds.centerX[node] + hX
+		&& box.minPoint.y >= bounds.centerY[node] - hY && box.maxPoint.y <= bounds.centerY[node] + hY
+		&& box.minPoint.z >= bounds.centerZ[node] - hZ && box.maxPoint.z <= bounds.centerZ[node] + hZ; 
+}
+
+// Which child holds a point: its Morton octant
+uint Octree::GetChildIndex(uint node, const float3& point) const
+{
+	return (uint)(point.x > bounds.centerX[node]) | ((uint)(point.y > bounds.centerY[node]) << 1) | ((uint)(point.z > bounds.centerZ[node]) << 2); 
+}
+
+// ----------------------------------------------------------------- [Object buckets]
+void Octree::AddToNode(uint node, uint handle)
+{
+	// Full bucket: move the node's objects to one twice as big
+	if (nodes[node].objCount == nodes[node].objCapacity)
+	{
+		uint capacity = (nodes[node].objCapacity == 0) ? OCTREE_MIN_BUCKET : nodes[node].objCapacity * 2; 
+		uint first = AllocateBucket(capacity); 
+		std::copy(objectRefs.begin() + nodes[node].objFirst, objectRefs.begin() + nodes[node].objFirst + nodes[node].objCount, objectRefs.begin() + first); 
+		std::copy(refLinks.begin() + nodes[node].objFirst, refLinks.begin() + nodes[node].objFirst + nodes[node].objCount, refLinks.begin() + first); // slots stay
+		FreeBucket(nodes[node].objFirst, nodes[node].objCapacity); 
+
+		nodes[node].objFirst = first; 
+		nodes[node].objCapacity = capacity; 
+	}
+
+	objectRefs[nodes[node].objFirst + nodes[node].objCount] = handle; 
+	LinkRef(handle, node, nodes[node].objCount++); 
+}
+
+// The order inside a bucket does not matter: swap with the last one and pop. The last one's back-reference follows it
+void Octree::RemoveFromNodeAt(uint node, uint slot)
+{
+	OctreeNode& n = nodes[node]; 
+	uint entry = n.objFirst + slot, last = n.objFirst + n.objCount - 1; 
+	UnlinkRef(objectRefs[entry], refLinks[entry]); 
+
+	objectRefs[entry] = objectRefs[last]; 
+	refLinks[entry] = refLinks[last]; 
+	refPool[refLinks[entry]].slot = slot; 
+	n.objCount--; 
+}
+
+// The entry at the slot must be filled already
+void Octree::LinkRef(uint handle, uint node, uint slot)
+{
+	uint ref = freeRef; 
+	if (ref != OCTREE_NONE)
+		freeRef = refPool[ref].next; 
+	else
+	{
+		ref = refPool.size(); 
+		refPool.push_back(OctreeObjectRef()); 
+	}
+
+	refPool[ref] = { node, slot, objectFirstRef[handle] }; 
+	objectFirstRef[handle] = ref; 
+	refLinks[nodes[node].objFirst + slot] = ref; 
+}
+
+// O(the object's refs): one, in a loose tree
+void Octree::UnlinkRef(uint handle, uint ref)
+{
+	uint* link = &objectFirstRef[handle]; 
+	while (*link != ref)
+		link = &refPool[*link].next; 
+	*link = refPool[ref].next; 
+
+	refPool[ref].next = freeRef; 
+	freeRef = ref; 
+}
+
+uint Octree::AllocateBucket(uint capacity)
+{
+	uint sizeClass = 0; 
+	while ((OCTREE_MIN_BUCKET << sizeClass) < capacity)
+		sizeClass++; 
+
+	if (sizeClass < freeBuckets.size() && freeBuckets[sizeClass].empty() == false)
+	{
+		uint first = freeBuckets[sizeClass].back(); 
+		freeBuckets[sizeClass].pop_back(); 
+		return first; 
+	}
+
+	uint first = objectRefs.size(); 
+	objectRefs.resize(first + capacity); 
+	refLinks.resize(first + capacity); 
+	return first; 
+}
+
+void Octree::FreeBucket(uint first, uint capacity)
+{
+	if (capacity == 0)
+		return; 
+
+	uint sizeClass = 0;
+	while ((OCTREE_MIN_BUCKET << sizeClass) < capacity)
+		sizeClass++;
+
+	if (sizeClass >= freeBuckets.size())
+		freeBuckets.resize(sizeClass + 1); 
+	freeBuckets[sizeClass].push_back(first); 
+}
+
+// ----------------------------------------------------------------- [Object handles]
+uint Octree::AcquireHandle(GameObject* obj)
+{
+	uint handle = 0; 
+	if (freeHandles.empty() == false)
+	{
+		handle = freeHandles.back(); 
+		freeHandles.pop_back(); 
+		objects[handle] = obj; 
+		objectFirstRef[handle] = OCTREE_NONE; 
+	}
+	else
+	{
+		handle = objects.size(); 
+		objects.push_back(obj); 
+		objectFirstRef.push_back(OCTREE_NONE); 
+	}
+
+	return obj->spatialHandle = handle; 
+}
+
+void Octree::ReleaseHandle(uint handle)
+{
+	objects[handle]->spatialHandle = OCTREE_NONE; 
+	objects[handle] = nullptr; 
+	objectFirstRef[handle] = OCTREE_NONE; 
+	freeHandles.push_back(handle); 
+}
+
+// ----------------------------------------------------------------- [Bounds]
+void OctreeBounds::Push(const float3& center, const float3& halfSize)
+{
+	centerX.push_back(center.x); 
+	centerY.push_back(center.y);
+	centerZ.push_back(center.z);
+	halfX.push_back(halfSize.x);
+	halfY.push_back(halfSize.y);
+	halfZ.push_back(halfSize.z);
+}
+
+void OctreeBounds::Resize(uint size)
+{
+	centerX.resize(size); 
+	centerY.resize(size);
+	centerZ.resize(size);
+	halfX.resize(size);
+	halfY.resize(size);
+	halfZ.resize(size);
+}
+
+void OctreeBounds::Clear()
+{
+	Resize(0); 
+}
+
+void OctreeBounds::Set(uint index, const float3& center, const float3& halfSize)
+{
+	centerX[index] = center.x; 
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	halfX[index] = halfSize.x;
+	halfY[index] = halfSize.y;
+	halfZ[index] = halfSize.z;
+}
+
+// ----------------------------------------------------------------- [Queries]
+static thread_local std::vector<std::vector<uint64_t>> visitedScratch; // by nesting depth
+static thread_local uint visitedDepth = 0; 
+
+OctreeVisited::OctreeVisited(uint handleCount, bool track)
+{
+	if (track == false)
+		return; 
+
+	// a stack of scratches per thread: queries on other threads never touch it, and a nested query takes the one above
+	// its caller's. Growing the stack moves the scratches, not their buffers, so the callers' words stay valid
+	if (visitedDepth == visitedScratch.size())
+		visitedScratch.emplace_back(); 
+	std::vector<uint64_t>& scratch = visitedScratch[visitedDepth++]; 
+	scratch.assign((handleCount + 63) / 64, 0); 
+	words = scratch.data(); 
+}
+
+OctreeVisited::~OctreeVisited()
+{
+	if (words != nullptr)
+		visitedDepth--; 
+}
+
+void Octree::CollectCandidates(std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects) const
+{
+	OctreeVisited visited(objects.size(), IsLoose() == false);
+	SpatialQueryCounters counters; 
+	uint first = gameObjects.size(); 
+	CollectNodeCandidates(0, gameObjects, query, testObjects, visited, counters); 
+
+	counters.candidates = gameObjects.size() - first; 
+	RecordQuery(SPATIAL_QUERY::CANDIDATES, counters); 
+}
+
+void Octree::CollectNodeCandidates(uint node, std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects, OctreeVisited& visited, SpatialQueryCounters& counters) const
+{
+	counters.aabbTests++; 
+	if (query.Intersects(GetQueryAABB(node)) == false)
+		return;
+
+	counters.nodesVisited++; 
+	const OctreeNode& n = nodes[node];
+	if (testObjects && n.objCount > 0)
+		nodeHits.Hit(node); 
+	for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+	{
+		if (visited.Visit(objectRefs[i]) == false)
+			continue; 
+		GameObject* obj = objects[objectRefs[i]];
+		counters.objectTests += testObjects; 
+		if (testObjects == false || query.Intersects(obj->GetBoundingData().OBB))
+			gameObjects.push_back(obj);
+	}
+
+	if (n.IsLeaf() == false)
+		for (uint i = 0; i < 8; ++i)
+			CollectNodeCandidates(n.firstChild + i, gameObjects, query, testObjects, visited, counters);
+}
+
+void Octree::CollectFrustrumCandidates(std::vector<GameObject*>& gameObjects, const Frustrum& frustrum) const
+{
+	OctreeVisited visited(objects.size(), IsLoose() == false);
+	SpatialQueryCounters counters;
+	uint first = gameObjects.size();
+	CollectNodeFrustrum(0, gameObjects, frustrum, FRUSTRUM_ALL_PLANES, visited, counters); 
+
+	counters.candidates = gameObjects.size() - first;
+	RecordQuery(SPATIAL_QUERY::FRUSTRUM, counters);
+}
+
+void Octree::CollectNodeFrustrum(uint node, std::vector<GameObject*>& gameObjects, const Frustrum& frustrum, uint planeMask, OctreeVisited& visited, SpatialQueryCounters& counters) const
+{
+	float3 center(bounds.centerX[node], bounds.centerY[node], bounds.centerZ[node]);
+	float3 half(bounds.halfX[node] * looseness, bounds.halfY[node] * looseness, bounds.halfZ[node] * looseness);
+
+	// The root may keep objects out of its bounds, so it is never given away  
+	counters.aabbTests++;
+	Frustrum::INTERSECTION_TYPE type = frustrum.ClassifyAABB(center, half, planeMask); 
+	if (type == Frustrum::INTERSECTION_TYPE::OUTSIDE && node != 0)
+		return;
+	if (type == Frustrum::INTERSECTION_TYPE::INSIDE && node != 0)
+	{
+		// objects kept by a node touch its (loose) bounds, so they are all visible
+		CollectSubtree(node, gameObjects, visited, counters); 
+		return; 
+	}
+
+	counters.nodesVisited++;
+	const OctreeNode& n = nodes[node];
+	if (n.objCount > 0)
+		nodeHits.Hit(node); 
+	for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+	{
+		if (visited.Visit(objectRefs[i]) == false)
+			continue; 
+		GameObject* obj = objects[objectRefs[i]];
+		counters.objectTests++;
+		if (frustrum.ClassifyOBB(obj->GetBoundingData().OBB, (node == 0) ? FRUSTRUM_ALL_PLANES : planeMask) != Frustrum::INTERSECTION_TYPE::OUTSIDE)
+			gameObjects.push_back(obj);
+	}
+
+	if (n.IsLeaf() == false && type != Frustrum::INTERSECTION_TYPE::OUTSIDE)
+		for (uint i = 0; i < 8; ++i)
+			CollectNodeFrustrum(n.firstChild + i, gameObjects, frustrum, planeMask, visited, counters);
+}
+
+void Octree::CollectSubtree(uint node, std::vector<GameObject*>& gameObjects, OctreeVisited& visited, SpatialQueryCounters& counters) const
+{
+	counters.nodesVisited++;
+	const OctreeNode& n = nodes[node];
+	for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+		if (visited.Visit(objectRefs[i]))
+			gameObjects.push_back(objects[objectRefs[i]]);
+
+	if (n.IsLeaf() == false)
+		for (uint i = 0; i < 8; ++i)
+			CollectSubtree(n.firstChild + i, gameObjects, visited, counters);
+}
+
+// The root may keep objects out of its bounds, so it is always opened (at distance 0). Any other node holds its
+// objects inside its (loose) bounds, or in a classic tree, each part of an object is inside some node that holds it:
+// a node's distance is never greater than that of what it leads to
+SpatialHit Octree::Raycast(const math::LineSegment& ray, const SpatialRayTest& test) const
+{
+	SpatialHit closest; 
+	OctreeVisited visited(objects.size(), IsLoose() == false);
+	SpatialQueryCounters counters;
+	SpatialQueue queue; 
+	queue.push({ 0.f, 0, false }); 
+
+	while (queue.empty() == false && queue.top().distance < closest.distance)
+	{
+		SpatialQueueEntry entry = queue.top(); 
+		queue.pop(); 
+
+		float dNear = 0.f, dFar = 0.f; 
+		if (entry.isObject)
+		{
+			counters.candidates++; 
+			if (test(objects[entry.index], dNear) && dNear < closest.distance)
+				closest = { objects[entry.index], dNear }; 
+			continue; 
+		}
+
+		counters.nodesVisited++;
+		const OctreeNode& n = nodes[entry.index];
+		if (n.objCount > 0)
+			nodeHits.Hit(entry.index); 
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+		{
+			if (visited.Visit(objectRefs[i]) == false)
+				continue; 
+			counters.objectTests++;
+			if (objects[objectRefs[i]]->GetBoundingData().OBB.Intersects(ray, dNear, dFar))
+				queue.push({ dNear, objectRefs[i], true }); 
+		}
+
+		if (n.IsLeaf() == false)
+			for (uint i = 0; i < 8; ++i)
+			{
+				counters.aabbTests++;
+				if (GetQueryAABB(n.firstChild + i).Intersects(ray, dNear, dFar))
+					queue.push({ dNear, n.firstChild + i, false });
+			}
+	}
+
+	RecordQuery(SPATIAL_QUERY::RAYCAST, counters);
+	return closest; 
+}
+
+void Octree::CollectNearest(std::vector<SpatialHit>& hits, const float3& point, uint count, float maxDistance) const
+{
+	OctreeVisited visited(objects.size(), IsLoose() == false);
+	SpatialQueryCounters counters;
+	SpatialQueue queue;
+	queue.push({ 0.f, 0, false });
+
+	// objects come out of the queue by their exact distance, so in order
+	while (queue.empty() == false && counters.candidates < count)
+	{
+		SpatialQueueEntry entry = queue.top();
+		queue.pop();
+
+		if (entry.isObject)
+		{
+			hits.push_back({ objects[entry.index], entry.distance }); 
+			counters.candidates++; 
+			continue;
+		}
+
+		counters.nodesVisited++;
+		const OctreeNode& n = nodes[entry.index];
+		if (n.objCount > 0)
+			nodeHits.Hit(entry.index); 
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+		{
+			if (visited.Visit(objectRefs[i]) == false)
+				continue; 
+			counters.objectTests++;
+			float distance = objects[objectRefs[i]]->GetBoundingData().OBB.Distance(point);
+			if (distance <= maxDistance)
+				queue.push({ distance, objectRefs[i], true });
+		}
+
+		if (n.IsLeaf() == false)
+			for (uint i = 0; i < 8; ++i)
+			{
+				counters.aabbTests++;
+				float distance = GetQueryAABB(n.firstChild + i).Distance(point); 
+				if (distance <= maxDistance)
+					queue.push({ distance, n.firstChild + i, false });
+			}
+	}
+
+	RecordQuery(SPATIAL_QUERY::NEAREST, counters);
+}
+
+// ----------------------------------------------------------------- [Tuning]
+void Octree::CopyTuneData(OctreeTuneData& data) const
+{
+	math::AABB box; 
+	box.SetNegativeInfinity(); 
+	for (auto& obj : objects)
+	{
+		if (obj == nullptr)
+			continue; 
+		const auto& bounding = obj->GetBoundingData(); 
+		data.boxes.push_back(bounding.AABB); 
+		data.obbs.push_back(bounding.OBB); 
+		if (bounding.AABB.IsFinite())
+			box.Enclose(bounding.AABB); 
+	}
+
+	data.root = (box.IsFinite()) ? FitCube(box) : GetNodeAABB(0); 
+	data.looseness = looseness; 
+}
+
+// Same traversals as the queries, over a bulk built tree (each object kept once, no visited set needed)
+static uint ReplayFrustrum(const OctreeTuneData& data, const OctreeBulkOutput& tree, const Frustrum& frustrum, uint node, uint planeMask)
+{
+	const OctreeNode& n = tree.nodes[node]; 
+	Frustrum::INTERSECTION_TYPE type = frustrum.ClassifyAABB(tree.centers[node], tree.halves[node] * data.looseness, planeMask); 
+	if (type == Frustrum::INTERSECTION_TYPE::OUTSIDE && node != 0)
+		return 0; 
+
+	uint ret = 0; 
+	for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+		ret += (type == Frustrum::INTERSECTION_TYPE::INSIDE && node != 0) 
+			|| frustrum.ClassifyOBB(data.obbs[tree.refs[i]], (node == 0) ? FRUSTRUM_ALL_PLANES : planeMask) != Frustrum::INTERSECTION_TYPE::OUTSIDE; 
+
+	if (n.IsLeaf() == false && type != Frustrum::INTERSECTION_TYPE::OUTSIDE)
+		for (uint i = 0; i < 8; ++i)
+			ret += ReplayFrustrum(data, tree, frustrum, n.firstChild + i, planeMask); 
+	return ret; 
+}
+
+static uint ReplayRay(const OctreeTuneData& data, const OctreeBulkOutput& tree, const math::LineSegment& ray)
+{
+	SpatialQueue queue; 
+	queue.push({ 0.f, 0, false }); 
+	float closest = FLOAT_INF; 
+	uint ret = 0; 
+
+	while (queue.empty() == false && queue.top().distance < closest)
+	{
+		SpatialQueueEntry entry = queue.top(); 
+		queue.pop(); 
+
+		float dNear = 0.f, dFar = 0.f; 
+		if (entry.isObject) // no mesh here: the box hit counts
+		{
+			closest = entry.distance; 
+			ret++; 
+			continue; 
+		}
+
+		const OctreeNode& n = tree.nodes[entry.index]; 
+		for (uint i = n.objFirst; i < n.objFirst + n.objCount; ++i)
+			if (data.obbs[tree.refs[i]].Intersects(ray, dNear, dFar))
+				queue.push({ dNear, tree.refs[i], true }); 
+
+		if (n.IsLeaf() == false)
+			for (uint i = n.firstChild; i < n.firstChild + 8; ++i)
+			{
+				math::AABB box(tree.centers[i] - tree.halves[i] * data.looseness, tree.centers[i] + tree.halves[i] * data.looseness); 
+				if (box.Intersects(ray, dNear, dFar))
+					queue.push({ dNear, i, false }); 
+			}
+	}
+
+	return ret; 
+}
+
+// Builds a tree with the parameters over the copied boxes (on this thread) and times the replay of the queries on
+// it. The fastest of OCTREE_TUNE_REPEATS replays, in ms: the build itself is not counted
+double Octree::MeasureReplay(const OctreeTuneData& data, uint maxDepth, uint maxNodeObjects)
+{
+	std::vector<OctreeBulkItem> items; 
+	items.reserve(data.boxes.size()); 
+	for (uint handle = 0; handle < data.boxes.size(); ++handle)
+		items.push_back({ MortonCode(data.boxes[handle], data.root.minPoint, data.root.Size()), handle }); 
+	RadixSort(items); 
+
+	OctreeBulkContext ctx = { data.boxes, items, data.looseness, maxDepth, maxNodeObjects, UINT_MAX }; 
+	OctreeBulkOutput tree; 
+	tree.nodes.push_back(OctreeNode()); 
+	tree.centers.push_back(data.root.CenterPoint()); 
+	tree.halves.push_back(data.root.HalfSize()); 
+	BulkBuildNode(ctx, tree, 0, 0, items.size()); 
+
+	double best = DBL_MAX; 
+	volatile uint sink = 0; // the results, so the replay is not optimized away
+	for (uint repeat = 0; repeat < OCTREE_TUNE_REPEATS; ++repeat)
+	{
+		auto start = std::chrono::high_resolution_clock::now(); 
+		uint found = 0; 
+		for (auto& frustrum : data.frustrums)
+			found += ReplayFrustrum(data, tree, frustrum, 0, FRUSTRUM_ALL_PLANES); 
+		for (auto& ray : data.rays)
+			found += ReplayRay(data, tree, ray); 
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start; 
+
+		sink = sink + found; 
+		best = Min(best, elapsed.count()); 
+	}
+
+	return best; 
+}
+
+// ----------------------------------------------------------------- [Debug]
+void Octree::Debug() const
+{
+	for (uint node = 0; node < nodes.size(); ++node)
+		if (IsFree(node) == false)
+			DebugAABB(GetNodeAABB(node)); 
+}
+
+// debug sutff
+uint Octree::GetInsideCount() const
+{
+	uint ret = 0; 
+	for (auto& node : nodes)
+		ret += node.objCount; 
+    
+	return ret; 
+}
+
+void Octree::GetTreeStats(SpatialStats& stats) const
+{
+	for (uint node = 0; node < nodes.size(); ++node)
+		if (IsFree(node) == false)
+			stats.AddNode(nodes[node].depth, nodes[node].objCount, nodes[node].IsLeaf()); 
+	stats.Finish(GetObjectCount()); 
+}
+
+uint Octree::GetNodesWithMaxObjects() const
+{
+	uint ret = 0; 
+	for (auto& node : nodes)
+		ret += (node.objCount >= maxNodeObjects); 
+
+	return ret;
+}
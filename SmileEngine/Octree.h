@@ -0,0 +1,239 @@
+#pragma once
+
+#include "SpatialIndex.h"
+#include "MathGeoLib/include/Math/float3.h"
+#include <cstdint>
+#include <memory>
+#include <atomic>
+
+#define DEFAULT_MAX_NODE_OBJECTS 10
+#define DEFAULT_MAX_DEPTH 8
+#define DEFAULT_LOOSENESS 1.f // 1 = classic octree. Above 1, nodes are loose: their query bounds are scaled around the center by this factor
+#define OCTREE_NONE SPATIAL_NONE
+#define OCTREE_MIN_BUCKET 4 // smallest object bucket a node gets in the shared object array
+#define OCTREE_MIN_ROOT_HALF_SIZE 1.f
+#define OCTREE_BULK_MIN_PARALLEL 1024 // fewer objects than this and the bulk build stays on this thread
+#define OCTREE_BULK_TASK_DEPTH 2 // the bulk build hands out the subtrees below this depth (up to 64) to the cores
+#define OCTREE_MAX_ROOT_GROWTH 16 // times the root can double for one object (then it is kept by the root, stranded)
+#define OCTREE_REBALANCE_SLICE 256 // nodes the rebalancing pass looks at each frame
+#define OCTREE_MERGE_OCCUPANCY 0.25f // 8 leaves with fewer objects than this (times the max per node) go back to their parent
+#define OCTREE_HOT_OCCUPANCY 0.5f // a hot leaf with more objects than this (times the max per node) is split
+#define OCTREE_HOT_HIT_RATE 0.5f // queries testing a leaf's objects per frame, for it to be hot
+
+struct OctreeBulkOutput;
+struct OctreeTuneData;
+
+// ----------------------------------------------------------------- [OctreeNode]
+// Nodes live in one contiguous pool and point to each other by index. The 8 children of a node are stored together:
+// child i is at firstChild + i, where i is the Morton octant of the child -> x | y << 1 | z << 2 (1 = upper half)
+struct OctreeNode
+{
+	uint parent = OCTREE_NONE;
+	uint firstChild = OCTREE_NONE;
+	uint depth = 0;
+	uint objFirst = 0, objCount = 0, objCapacity = 0; // the node's bucket in the shared object array
+
+	inline bool IsLeaf() const { return firstChild == OCTREE_NONE; };
+};
+
+// ----------------------------------------------------------------- [OctreeObjectRef]
+// Where an object is kept: a node and the slot in its bucket. Each object chains its refs (one in a loose tree, one or
+// more in a classic one), so it is taken out of every node that keeps it in O(refs), with no search
+struct OctreeObjectRef
+{
+	uint node = OCTREE_NONE;
+	uint slot = 0;
+	uint next = OCTREE_NONE; // the object's next ref, or the next free one
+};
+
+// ----------------------------------------------------------------- [OctreeBounds]
+// Node bounds as structure of arrays (center and half size), indexed like the node pool
+struct OctreeBounds
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> halfX, halfY, halfZ;
+
+	void Push(const float3& center, const float3& halfSize);
+	void Resize(uint size);
+	void Clear();
+	void Set(uint index, const float3& center, const float3& halfSize);
+};
+
+// ----------------------------------------------------------------- [OctreeHits]
+// How many times queries tested each node's objects. Queries are const and may run at once, so the counters are
+// atomic. Only the rebalancing pass sizes them (it never runs with queries): nodes created since are not counted yet
+class OctreeHits
+{
+public:
+	inline void Hit(uint node) const
+	{
+		if (node < size)
+			counts[node].fetch_add(1, std::memory_order_relaxed);
+	};
+	void Resize(uint size); // keeps the counts
+	uint Take(uint node); // and resets it
+	uint GetSize() const { return size; };
+
+private:
+	std::unique_ptr<std::atomic<uint>[]> counts;
+	uint size = 0;
+};
+
+// ----------------------------------------------------------------- [OctreeVisited]
+// Per-query visited bitset, indexed by object handle. Each query owns one, so queries do not write to shared state.
+// A loose tree keeps each object in a single node, so it does not need one: "track" is false and everything passes.
+// A query started inside another one (e.g. from a ray test) on the same thread gets the next scratch, not the same one
+class OctreeVisited
+{
+public:
+	OctreeVisited(uint handleCount, bool track);
+	~OctreeVisited();
+	OctreeVisited(const OctreeVisited&) = delete;
+	OctreeVisited& operator=(const OctreeVisited&) = delete;
+	inline bool Visit(uint handle) // true the first time
+	{
+		if (words == nullptr)
+			return true;
+		uint64_t& word = words[handle >> 6];
+		uint64_t bit = (uint64_t)1 << (handle & 63);
+		if (word & bit)
+			return false;
+		word |= bit;
+		return true;
+	};
+
+private:
+	uint64_t* words = nullptr; // this thread's scratch at this query's nesting depth, reused between queries
+};
+
+// ----------------------------------------------------------------- [Octree]
+class Octree : public SpatialIndex
+{
+public:
+	// the aabb is the root until the first objects come in: then it fits them
+	Octree(math::AABB aabb, uint depth = DEFAULT_MAX_DEPTH, uint maxNodeObjects = DEFAULT_MAX_NODE_OBJECTS, float looseness = DEFAULT_LOOSENESS);
+	~Octree();
+
+	void Insert(GameObject* obj);
+	void InsertBatch(const std::vector<GameObject*>& objs);
+	void Remove(GameObject* obj);
+	void OnObjectMoved(GameObject* obj);
+	void Clear();
+	void Update(float dt); // rebalances a slice of the tree
+
+	void CollectCandidates(std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects) const;
+	// Planes a node is fully inside of are not tested again below it, and a node fully inside the frustrum gives
+	// away its whole subtree with no tests at all
+	void CollectFrustrumCandidates(std::vector<GameObject*>& gameObjects, const Frustrum& frustrum) const;
+	SpatialHit Raycast(const math::LineSegment& ray, const SpatialRayTest& test) const;
+	void CollectNearest(std::vector<SpatialHit>& hits, const float3& point, uint count, float maxDistance) const;
+
+	SPATIAL_BACKEND GetType() const { return SPATIAL_BACKEND::OCTREE; };
+	bool IndexesDynamicObjects() const { return IsLoose(); }; // a loose tree keeps static and non-static objects
+	uint GetNodeCount() const { return nodes.size() - freeOctets.size() * 8; };
+	uint GetInsideCount() const;
+	void Debug() const;
+
+	// Octree only
+	void SetLooseness(float looseness, GameObject* root); // rebuilds the tree, from the scene's root
+	void SetParameters(uint maxDepth, uint maxNodeObjects, GameObject* root); // rebuilds the tree, from the scene's root
+	float GetLooseness() const { return looseness; };
+	bool IsLoose() const { return looseness > 1.f; };
+	uint GetNodesWithMaxObjects() const;
+	uint GetStrandedCount() const; // objects kept by the root since they are out of it
+	uint GetObjectCount() const { return objects.size() - freeHandles.size(); };
+	uint GetMaxNodeObjects() const { return maxNodeObjects; };
+	uint GetMaxNodeDepth() const { return maxDepth; };
+	uint GetBaseMaxDepth() const { return baseMaxDepth; }; // the max depth before the root grew
+	math::AABB GetRootAABB() const { return GetNodeAABB(0); };
+	void SetRebalancing(bool rebalancing) { this->rebalancing = rebalancing; };
+	bool IsRebalancing() const { return rebalancing; };
+	uint GetMergeCount() const { return mergeCount; };
+	uint GetResplitCount() const { return resplitCount; };
+
+	// Tuning (see OctreeTuner): a copy of what a build needs, and the cost of replaying queries with other parameters
+	void CopyTuneData(OctreeTuneData& data) const; 
+	static double MeasureReplay(const OctreeTuneData& data, uint maxDepth, uint maxNodeObjects); 
+
+protected:
+	void GetTreeStats(SpatialStats& stats) const;
+
+private:
+	// Checks the query intersects with an octree node, then (if asked) checks it intersects with the objects inside the node
+	void CollectNodeCandidates(uint node, std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects, OctreeVisited& visited, SpatialQueryCounters& counters) const;
+	void CollectNodeFrustrum(uint node, std::vector<GameObject*>& gameObjects, const Frustrum& frustrum, uint planeMask, OctreeVisited& visited, SpatialQueryCounters& counters) const;
+	void CollectSubtree(uint node, std::vector<GameObject*>& gameObjects, OctreeVisited& visited, SpatialQueryCounters& counters) const;
+
+	// Root fitting and growth
+	bool Takes(GameObject* obj) const;
+	void FitRoot(const std::vector<GameObject*>& objs);
+	bool RootContains(const math::AABB& box) const;
+	void GrowToFit(const math::AABB& box);
+	void Reroot(const float3& towards);
+
+	// Rebalancing: collapses underfull octets and splits the leaves that are full or hot, a slice each frame
+	void Rebalance(uint budget);
+	void RebalanceNode(uint node);
+	bool CanCollapse(uint node) const;
+	void Collapse(uint node);
+
+	// Bulk build: Morton sorted, the subtrees built in parallel
+	void BulkBuild(const std::vector<GameObject*>& gathered);
+	void SpliceBulk(const OctreeBulkOutput& out, uint root);
+
+	// Tree building
+	void InsertObject(uint node, uint handle);
+	void InsertObjectLoose(uint node, uint handle); // the object is kept by the deepest node whose loose bounds contain it
+	void DeleteObject(uint handle); // from every node that keeps it
+	void Split(uint node);
+	uint AllocateOctet(uint parent, uint depth); // 8 children, maybe the ones of a collapsed node
+	bool SendObjectToChildren(uint node, uint handle);
+	void RearrangeObjectsInChildren(uint node);
+	void RearrangeObjectsLoose(uint node);
+
+	// Node data
+	math::AABB GetNodeAABB(uint node) const;
+	math::AABB GetQueryAABB(uint node) const; // the loose bounds (same as the AABB in a classic octree)
+	bool LooseContains(uint node, const math::AABB& box) const;
+	bool IsFree(uint node) const { return node != 0 && nodes[node].parent == OCTREE_NONE; }; // of a collapsed node
+	uint GetChildIndex(uint node, const float3& point) const;
+	uint GetObjectNode(uint handle) const { return refPool[objectFirstRef[handle]].node; }; // loose tree
+
+	// Object buckets in the shared array
+	void AddToNode(uint node, uint handle);
+	void RemoveFromNodeAt(uint node, uint slot);
+	void LinkRef(uint handle, uint node, uint slot);
+	void UnlinkRef(uint handle, uint ref);
+	uint AllocateBucket(uint capacity);
+	void FreeBucket(uint first, uint capacity);
+
+	// Object handles
+	uint AcquireHandle(GameObject* obj);
+	void ReleaseHandle(uint handle);
+
+private:
+	uint maxDepth = DEFAULT_MAX_DEPTH; // grows with the root
+	uint baseMaxDepth = DEFAULT_MAX_DEPTH;
+	uint maxNodeObjects = DEFAULT_MAX_NODE_OBJECTS;
+	float looseness = DEFAULT_LOOSENESS;
+
+	std::vector<OctreeNode> nodes; // nodes[0] is the root
+	OctreeBounds bounds;
+	std::vector<uint> freeOctets; // first node of each, to be reused by splits
+	OctreeHits nodeHits;
+
+	bool rebalancing = true;
+	uint rebalanceCursor = 0; // next node to look at
+	uint sweepFrames = 0, lastSweepFrames = 1; // frames the current and last sweeps of the tree took
+	uint mergeCount = 0, resplitCount = 0;
+
+	std::vector<uint> objectRefs; // every node's objects, as handles, each node owns a bucket
+	std::vector<uint> refLinks; // parallel to objectRefs: the back-reference of each entry
+	std::vector<std::vector<uint>> freeBuckets; // free bucket starts, by size class (OCTREE_MIN_BUCKET << class)
+
+	std::vector<GameObject*> objects; // handle -> object
+	std::vector<uint> objectFirstRef; // handle -> its first back-reference. In a loose tree, the only one: its node
+	std::vector<OctreeObjectRef> refPool;
+	uint freeRef = OCTREE_NONE;
+	std::vector<uint> freeHandles;
+};
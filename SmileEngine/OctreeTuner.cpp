@@ -0,0 +1,111 @@
+#include "OctreeTuner.h"
+#include <chrono>
+
+// The candidates: every pair of these (plus the current one)
+static const uint tuneDepths[] = { 4, 6, 8, 10, 12 };
+static const uint tuneNodeObjects[] = { 2, 4, 8, 16, 32 };
+
+OctreeTuner::~OctreeTuner()
+{
+	Cancel();
+}
+
+void OctreeTuner::Start()
+{
+	Cancel();
+	state = OCTREE_TUNE_STATE::RECORDING;
+}
+
+// A run can not be stopped halfway: it is waited for
+void OctreeTuner::Cancel()
+{
+	if (run.valid())
+		run.wait();
+	run = std::future<void>();
+	data.reset();
+	results.clear();
+	best = 0;
+
+	std::lock_guard<std::mutex> lock(recordMutex);
+	frustrums.clear();
+	rays.clear();
+	state = OCTREE_TUNE_STATE::IDLE;
+}
+
+void OctreeTuner::RecordFrustrum(const Frustrum& frustrum)
+{
+	if (state != OCTREE_TUNE_STATE::RECORDING)
+		return;
+
+	std::lock_guard<std::mutex> lock(recordMutex);
+	if (frustrums.size() < OCTREE_TUNE_FRUSTRUMS)
+		frustrums.push_back(frustrum);
+}
+
+void OctreeTuner::RecordRay(const math::LineSegment& ray)
+{
+	if (state != OCTREE_TUNE_STATE::RECORDING)
+		return;
+
+	std::lock_guard<std::mutex> lock(recordMutex);
+	if (rays.size() < OCTREE_TUNE_RAYS)
+		rays.push_back(ray);
+}
+
+bool OctreeTuner::Update(const Octree& octree)
+{
+	// A) Enough recorded: copy the objects' bounds and the queries, and run with them in the background
+	if (state == OCTREE_TUNE_STATE::RECORDING)
+	{
+		std::lock_guard<std::mutex> lock(recordMutex);
+		if (frustrums.size() < OCTREE_TUNE_FRUSTRUMS)
+			return false;
+
+		data = std::make_unique<OctreeTuneData>();
+		octree.CopyTuneData(*data);
+		data->frustrums.swap(frustrums);
+		data->rays.swap(rays);
+
+		results.clear();
+		results.push_back({ octree.GetBaseMaxDepth(), octree.GetMaxNodeObjects() });
+		for (uint depth : tuneDepths)
+			for (uint nodeObjects : tuneNodeObjects)
+				if (depth != results[0].maxDepth || nodeObjects != results[0].maxNodeObjects)
+					results.push_back({ depth, nodeObjects });
+
+		state = OCTREE_TUNE_STATE::RUNNING;
+		const OctreeTuneData* runData = data.get();
+		std::vector<OctreeTuneResult>* runResults = &results;
+		run = std::async(std::launch::async, [runData, runResults]() { Run(*runData, *runResults); });
+		return false;
+	}
+
+	// B) The run is done: the cheapest one
+	if (state == OCTREE_TUNE_STATE::RUNNING && run.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		run.get();
+		data.reset();
+
+		best = 0;
+		for (uint i = 1; i < results.size(); ++i)
+			if (results[i].cost < results[best].cost)
+				best = i;
+
+		state = OCTREE_TUNE_STATE::DONE;
+		return true;
+	}
+
+	return false;
+}
+
+bool OctreeTuner::BeatsCurrent() const
+{
+	return best != 0 && results[best].cost < results[0].cost * (1.0 - OCTREE_TUNE_MIN_GAIN);
+}
+
+// No access to the scene: works only with the copied data
+void OctreeTuner::Run(const OctreeTuneData& data, std::vector<OctreeTuneResult>& results)
+{
+	for (auto& result : results)
+		result.cost = Octree::MeasureReplay(data, result.maxDepth, result.maxNodeObjects);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Octree.h"
+#include "Component.h"
+#include "ComponentCamera.h"
+#include "MathGeoLib/include/Geometry/LineSegment.h"
+#include "MathGeoLib/include/Geometry/OBB.h"
+#include <future>
+#include <mutex>
+
+#define OCTREE_TUNE_FRUSTRUMS 32 // frustrum queries recorded (about one per frame) before a run starts
+#define OCTREE_TUNE_RAYS 128 // ray queries kept, at most
+#define OCTREE_TUNE_REPEATS 3 // each replay is timed this many times: the fastest counts
+#define OCTREE_TUNE_MIN_GAIN 0.05f // a candidate must be this much cheaper than the current parameters to be adopted
+
+// ----------------------------------------------------------------- [OctreeTuneData]
+// What a run needs: a copy of the objects' bounds and of the recorded queries, so it can run on another thread
+struct OctreeTuneData
+{
+	math::AABB root; // fit to the boxes, like a fresh build
+	float looseness = DEFAULT_LOOSENESS;
+	std::vector<math::AABB> boxes;
+	std::vector<math::OBB> obbs;
+	std::vector<Frustrum> frustrums;
+	std::vector<math::LineSegment> rays;
+};
+
+struct OctreeTuneResult
+{
+	uint maxDepth = DEFAULT_MAX_DEPTH;
+	uint maxNodeObjects = DEFAULT_MAX_NODE_OBJECTS;
+	double cost = 0.0; // ms, to replay the queries
+};
+
+enum class OCTREE_TUNE_STATE
+{
+	IDLE,
+	RECORDING,
+	RUNNING,
+	DONE
+};
+
+// ----------------------------------------------------------------- [OctreeTuner]
+// Picks the octree's max depth and objects per node for the scene at hand. It records the frustrum and ray queries
+// of some frames, then, in the background, builds a tree with each candidate pair over a copy of the objects' bounds
+// and times the replay of the queries on it. The current pair is measured the same way, as the one to beat
+class OctreeTuner
+{
+public:
+	~OctreeTuner();
+
+	void Start(); // records from now on
+	void Cancel();
+
+	// The queries to replay. Thread safe, and next to free unless recording
+	void RecordFrustrum(const Frustrum& frustrum);
+	void RecordRay(const math::LineSegment& ray);
+
+	// Once a frame: starts the run once enough is recorded. True the frame the results are in
+	bool Update(const Octree& octree);
+
+	OCTREE_TUNE_STATE GetState() const { return state; };
+	const std::vector<OctreeTuneResult>& GetResults() const { return results; }; // when DONE. [0] is the current pair
+	const OctreeTuneResult& GetBest() const { return results[best]; }; // when DONE
+	bool BeatsCurrent() const; // by OCTREE_TUNE_MIN_GAIN at least
+
+private:
+	static void Run(const OctreeTuneData& data, std::vector<OctreeTuneResult>& results);
+
+private:
+	std::atomic<OCTREE_TUNE_STATE> state = OCTREE_TUNE_STATE::IDLE;
+	std::mutex recordMutex;
+	std::vector<Frustrum> frustrums;
+	std::vector<math::LineSegment> rays;
+
+	std::unique_ptr<OctreeTuneData> data;
+	std::vector<OctreeTuneResult> results;
+	uint best = 0;
+	std::future<void> run;
+};
@@ -0,0 +1,83 @@
+#include "ParticleEffectPool.h"
+#include "SmileApp.h"
+#include "GameObject.h"
+#include "ComponentParticleEmitter.h"
+#include "ComponentTransform.h"
+#include "SmileGameObjectManager.h"
+#include "SmileSpatialTree.h"
+#include "RNG.h"
+#include <algorithm>
+
+// -----------------------------------------------------------------
+GameObject* ParticleEffectPool::Spawn(particleEffect effect, const float4x4& transform)
+{
+	if (seeded == false)
+	{
+		random.Seed(RNG::GetRandomUUID());
+		seeded = true;
+	}
+
+	GameObject* root = App->scene_intro->rootObj;
+	AllData data = ParticlePresets::Get(effect, random);
+	std::vector<GameObject*>& free = idle[(int)effect];
+
+	// 1) An idle one, restarted, or the first of its kind
+	GameObject* obj = nullptr;
+	if (free.empty() == false)
+	{
+		obj = free.back();
+		free.pop_back();
+		obj->GetEmitter()->Restart(data);
+		obj->SetParent(root);
+	}
+	else
+	{
+		obj = App->object_manager->CreateGameObject("Emitter", root);
+		auto emitter = DBG_NEW ComponentParticleEmitter(obj, data);
+		obj->AddComponent((Component*)emitter);
+		emitter->effect = effect;
+		emitter->destroyOnFinish = true;
+	}
+
+	// 2) In the scene. Start sets up the bounding box
+	obj->GetTransform()->SetGlobalMatrix(transform);
+	obj->Start();
+	App->spatial_tree->OnStaticChange(obj, true);
+
+	return obj;
+}
+
+// -----------------------------------------------------------------
+void ParticleEffectPool::Release(GameObject* obj)
+{
+	auto emitter = obj->GetEmitter();
+	if (emitter == nullptr || emitter->effect == particleEffect::NONE)
+		return;
+
+	// Out of the scene: not updated, drawn or saved. The object stays as it is
+	obj->Disable();
+	App->spatial_tree->RemoveObject(obj);
+	GameObject* parent = obj->GetParent();
+	if (parent)
+	{
+		auto item = std::find(parent->childObjects.begin(), parent->childObjects.end(), obj);
+		if (item != parent->childObjects.end())
+			parent->childObjects.erase(item);
+	}
+
+	idle[(int)emitter->effect].push_back(obj);
+}
+
+// -----------------------------------------------------------------
+void ParticleEffectPool::CleanUp()
+{
+	for (auto& free : idle)
+	{
+		for (auto& obj : free)
+		{
+			obj->CleanUp();
+			RELEASE(obj);
+		}
+		free.clear();
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "SmileSetup.h"
+#include "ParticleSimulation.h"
+#include "MathGeoLib/include/Math/float4x4.h"
+#include <array>
+#include <vector>
+
+class GameObject;
+
+// ----------------------------------------------------------------- [ParticleEffectPool]
+// Short lived effects (e.g. fireworks) without the allocations: an emitter object that finishes comes back here,
+// out of the scene, with its particle buffer, and is handed out again, restarted, for the next effect of its kind.
+// Only the first ones of each kind are created. They all draw with the same quad (see ComponentParticleEmitter)
+class ParticleEffectPool
+{
+public:
+	GameObject* Spawn(particleEffect effect, const float4x4& transform); // in the scene, started
+	void Release(GameObject* obj); // out of the scene, until spawned again. From the emitter, once it expires
+	void CleanUp(); // the idle ones. The ones in the scene go with it
+
+	uint GetIdleCount(particleEffect effect) const { return idle[(int)effect].size(); };
+
+private:
+	std::array<std::vector<GameObject*>, (int)particleEffect::MAX> idle;
+	ParticleRandom random; // the presets' variations. Seeded on first use
+	bool seeded = false;
+};
@@ -0,0 +1,278 @@
+#include "ParticleKernels.h"
+#include "MathGeoLib/include/Math/MathFunc.h"
+#include <array>
+#include <algorithm>
+#include <utility>
+
+#ifdef PARTICLE_SSE
+#include <emmintrin.h>
+#endif
+#ifdef PARTICLE_AVX
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------------------- [ParticleBuffer]
+void ParticleBuffer::Resize(uint count)
+{
+	for (auto array : { &posX, &posY, &posZ, &speedX, &speedY, &speedZ, &lifeTime, &size, &colorR, &colorG, &colorB, &colorA, &tileTime, &camDist })
+		array->resize(count, 0.f);
+	life.resize(count, 0.f); // dead
+	tile.resize(count, 0);
+	RebuildFreeSlots();
+}
+
+void ParticleBuffer::Clear()
+{
+	Resize(0);
+}
+
+uint ParticleBuffer::Allocate()
+{
+	uint i = freeSlots.back();
+	freeSlots.pop_back();
+	inUse[i] = true;
+	return i;
+}
+
+void ParticleBuffer::Reclaim()
+{
+	for (uint i = 0; i < Size(); ++i)
+	{
+		if (inUse[i] && life[i] <= 0.f)
+		{
+			inUse[i] = false;
+			freeSlots.push_back(i);
+		}
+	}
+}
+
+// Backwards: the first slots go first
+void ParticleBuffer::RebuildFreeSlots()
+{
+	inUse.resize(Size());
+	freeSlots.clear();
+	for (uint i = Size(); i-- > 0;)
+	{
+		inUse[i] = IsAlive(i);
+		if (inUse[i] == false)
+			freeSlots.push_back(i);
+	}
+}
+
+void ParticleBuffer::FindOldest(uint count, std::vector<uint>& out) const
+{
+	size_t first = out.size();
+	for (uint i = 0; i < Size(); ++i)
+		if (IsAlive(i))
+			out.push_back(i);
+
+	count = Min(count, (uint)(out.size() - first));
+	std::nth_element(out.begin() + first, out.begin() + first + count, out.end(), [this](uint a, uint b) { return lifeTime[a] > lifeTime[b]; });
+	out.resize(first + count);
+}
+
+math::AABB ParticleBuffer::GetLiveBounds(float reach) const
+{
+	float3 minPoint = float3::FromScalar(FLOAT_INF), maxPoint = float3::FromScalar(-FLOAT_INF);
+	for (uint i = 0; i < Size(); ++i)
+	{
+		if (IsAlive(i) == false)
+			continue;
+
+		float pad = size[i] * reach;
+		minPoint.x = Min(minPoint.x, posX[i] - pad);
+		minPoint.y = Min(minPoint.y, posY[i] - pad);
+		minPoint.z = Min(minPoint.z, posZ[i] - pad);
+		maxPoint.x = Max(maxPoint.x, posX[i] + pad);
+		maxPoint.y = Max(maxPoint.y, posY[i] + pad);
+		maxPoint.z = Max(maxPoint.z, posZ[i] + pad);
+	}
+	return math::AABB(minPoint, maxPoint);
+}
+
+// ----------------------------------------------------------------- [Scalar]
+// Next tile once its time is up, back to the first one at the end
+static inline void FlipbookStep(ParticleBuffer& p, uint i, bool alive, const ParticleUpdateParams& params, float dt)
+{
+	float time = p.tileTime[i] + dt;
+	bool next = alive && time >= params.tileTime;
+	uint tile = p.tile[i] + 1;
+	p.tile[i] = (next) ? ((tile < params.maxTiles - 1) ? tile : 0) : p.tile[i];
+	p.tileTime[i] = (next) ? 0.f : ((alive) ? time : p.tileTime[i]);
+}
+
+template<uint M>
+static void UpdateScalar(ParticleBuffer& p, const ParticleUpdateParams& params, float dt, uint first, uint last)
+{
+	const float step = params.decay * dt, fall = params.gravity * dt, invLife = 1.f / params.initialLife;
+	const float sizeRange = params.sizeTo - params.sizeFrom;
+	const float4 colorRange = params.colorTo - params.colorFrom;
+
+	for (uint i = first; i < last; ++i)
+	{
+		// Life goes down, time lived up. Both 0 once dead
+		float life = p.life[i] - step;
+		bool alive = life > 0.f;
+		p.life[i] = (alive) ? life : 0.f;
+		p.lifeTime[i] = (alive) ? p.lifeTime[i] + dt : 0.f;
+
+		// By the speed, and gravity by the time lived
+		p.posX[i] += p.speedX[i] * dt;
+		p.posY[i] += p.speedY[i] * dt;
+		p.posZ[i] += p.speedZ[i] * dt;
+		if constexpr ((M & PARTICLE_GRAVITY) != 0)
+			p.posY[i] -= fall * p.lifeTime[i];
+
+		// Lerp by the life spent
+		float spent = 1.f - p.life[i] * invLife;
+		if constexpr ((M & PARTICLE_SIZE) != 0)
+			p.size[i] = params.sizeFrom + spent * sizeRange;
+		if constexpr ((M & PARTICLE_COLOR) != 0)
+		{
+			p.colorR[i] = params.colorFrom.x + spent * colorRange.x;
+			p.colorG[i] = params.colorFrom.y + spent * colorRange.y;
+			p.colorB[i] = params.colorFrom.z + spent * colorRange.z;
+			p.colorA[i] = params.colorFrom.w + spent * colorRange.w;
+		}
+
+		if constexpr ((M & PARTICLE_FLIPBOOK) != 0)
+			FlipbookStep(p, i, alive, params, dt);
+	}
+}
+
+// ----------------------------------------------------------------- [SSE]
+#ifdef PARTICLE_SSE
+template<uint M>
+static void UpdateSSE(ParticleBuffer& p, const ParticleUpdateParams& params, float dt, uint first, uint last)
+{
+	uint wide = first + ((last - first) & ~3u);
+	const __m128 vDt = _mm_set1_ps(dt), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+	const __m128 step = _mm_set1_ps(params.decay * dt), fall = _mm_set1_ps(params.gravity * dt), invLife = _mm_set1_ps(1.f / params.initialLife);
+	const __m128 sizeFrom = _mm_set1_ps(params.sizeFrom), sizeRange = _mm_set1_ps(params.sizeTo - params.sizeFrom);
+	float* channels[4] = { p.colorR.data(), p.colorG.data(), p.colorB.data(), p.colorA.data() };
+	__m128 colorFrom[4], colorRange[4];
+	for (uint c = 0; c < 4; ++c)
+	{
+		colorFrom[c] = _mm_set1_ps(params.colorFrom[c]);
+		colorRange[c] = _mm_set1_ps(params.colorTo[c] - params.colorFrom[c]);
+	}
+
+	for (uint i = first; i < wide; i += 4)
+	{
+		__m128 life = _mm_sub_ps(_mm_loadu_ps(&p.life[i]), step);
+		__m128 alive = _mm_cmpgt_ps(life, zero);
+		life = _mm_max_ps(life, zero);
+		__m128 lifeTime = _mm_and_ps(alive, _mm_add_ps(_mm_loadu_ps(&p.lifeTime[i]), vDt));
+		_mm_storeu_ps(&p.life[i], life);
+		_mm_storeu_ps(&p.lifeTime[i], lifeTime);
+
+		__m128 posY = _mm_add_ps(_mm_loadu_ps(&p.posY[i]), _mm_mul_ps(_mm_loadu_ps(&p.speedY[i]), vDt));
+		if constexpr ((M & PARTICLE_GRAVITY) != 0)
+			posY = _mm_sub_ps(posY, _mm_mul_ps(fall, lifeTime));
+		_mm_storeu_ps(&p.posX[i], _mm_add_ps(_mm_loadu_ps(&p.posX[i]), _mm_mul_ps(_mm_loadu_ps(&p.speedX[i]), vDt)));
+		_mm_storeu_ps(&p.posY[i], posY);
+		_mm_storeu_ps(&p.posZ[i], _mm_add_ps(_mm_loadu_ps(&p.posZ[i]), _mm_mul_ps(_mm_loadu_ps(&p.speedZ[i]), vDt)));
+
+		__m128 spent = _mm_sub_ps(one, _mm_mul_ps(life, invLife));
+		if constexpr ((M & PARTICLE_SIZE) != 0)
+			_mm_storeu_ps(&p.size[i], _mm_add_ps(sizeFrom, _mm_mul_ps(spent, sizeRange)));
+		if constexpr ((M & PARTICLE_COLOR) != 0)
+			for (uint c = 0; c < 4; ++c)
+				_mm_storeu_ps(&channels[c][i], _mm_add_ps(colorFrom[c], _mm_mul_ps(spent, colorRange[c])));
+
+		// Integer and byte lanes: one by one
+		if constexpr ((M & PARTICLE_FLIPBOOK) != 0)
+			for (uint j = i; j < i + 4; ++j)
+				FlipbookStep(p, j, p.life[j] > 0.f, params, dt);
+	}
+	UpdateScalar<M>(p, params, dt, wide, last);
+}
+#endif
+
+// ----------------------------------------------------------------- [AVX]
+#ifdef PARTICLE_AVX
+template<uint M>
+static void UpdateAVX(ParticleBuffer& p, const ParticleUpdateParams& params, float dt, uint first, uint last)
+{
+	uint wide = first + ((last - first) & ~7u);
+	const __m256 vDt = _mm256_set1_ps(dt), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+	const __m256 step = _mm256_set1_ps(params.decay * dt), fall = _mm256_set1_ps(params.gravity * dt), invLife = _mm256_set1_ps(1.f / params.initialLife);
+	const __m256 sizeFrom = _mm256_set1_ps(params.sizeFrom), sizeRange = _mm256_set1_ps(params.sizeTo - params.sizeFrom);
+	float* channels[4] = { p.colorR.data(), p.colorG.data(), p.colorB.data(), p.colorA.data() };
+	__m256 colorFrom[4], colorRange[4];
+	for (uint c = 0; c < 4; ++c)
+	{
+		colorFrom[c] = _mm256_set1_ps(params.colorFrom[c]);
+		colorRange[c] = _mm256_set1_ps(params.colorTo[c] - params.colorFrom[c]);
+	}
+
+	for (uint i = first; i < wide; i += 8)
+	{
+		__m256 life = _mm256_sub_ps(_mm256_loadu_ps(&p.life[i]), step);
+		__m256 alive = _mm256_cmp_ps(life, zero, _CMP_GT_OQ);
+		life = _mm256_max_ps(life, zero);
+		__m256 lifeTime = _mm256_and_ps(alive, _mm256_add_ps(_mm256_loadu_ps(&p.lifeTime[i]), vDt));
+		_mm256_storeu_ps(&p.life[i], life);
+		_mm256_storeu_ps(&p.lifeTime[i], lifeTime);
+
+		__m256 posY = _mm256_add_ps(_mm256_loadu_ps(&p.posY[i]), _mm256_mul_ps(_mm256_loadu_ps(&p.speedY[i]), vDt));
+		if constexpr ((M & PARTICLE_GRAVITY) != 0)
+			posY = _mm256_sub_ps(posY, _mm256_mul_ps(fall, lifeTime));
+		_mm256_storeu_ps(&p.posX[i], _mm256_add_ps(_mm256_loadu_ps(&p.posX[i]), _mm256_mul_ps(_mm256_loadu_ps(&p.speedX[i]), vDt)));
+		_mm256_storeu_ps(&p.posY[i], posY);
+		_mm256_storeu_ps(&p.posZ[i], _mm256_add_ps(_mm256_loadu_ps(&p.posZ[i]), _mm256_mul_ps(_mm256_loadu_ps(&p.speedZ[i]), vDt)));
+
+		__m256 spent = _mm256_sub_ps(one, _mm256_mul_ps(life, invLife));
+		if constexpr ((M & PARTICLE_SIZE) != 0)
+			_mm256_storeu_ps(&p.size[i], _mm256_add_ps(sizeFrom, _mm256_mul_ps(spent, sizeRange)));
+		if constexpr ((M & PARTICLE_COLOR) != 0)
+			for (uint c = 0; c < 4; ++c)
+				_mm256_storeu_ps(&channels[c][i], _mm256_add_ps(colorFrom[c], _mm256_mul_ps(spent, colorRange[c])));
+
+		// Integer and byte lanes: one by one
+		if constexpr ((M & PARTICLE_FLIPBOOK) != 0)
+			for (uint j = i; j < i + 8; ++j)
+				FlipbookStep(p, j, p.life[j] > 0.f, params, dt);
+	}
+	UpdateScalar<M>(p, params, dt, wide, last);
+}
+#endif
+
+// ----------------------------------------------------------------- [Dispatch]
+template<uint M>
+static void Update(ParticleBuffer& p, const ParticleUpdateParams& params, float dt, uint first, uint last)
+{
+#if defined(PARTICLE_AVX)
+	UpdateAVX<M>(p, params, dt, first, last);
+#elif defined(PARTICLE_SSE)
+	UpdateSSE<M>(p, params, dt, first, last);
+#else
+	UpdateScalar<M>(p, params, dt, first, last);
+#endif
+}
+
+// One instance per combination of modules, indexed by the combination
+template<uint... M>
+static constexpr std::array<ParticleUpdateKernel, sizeof...(M)> MakeUpdateTable(std::integer_sequence<uint, M...>)
+{
+	return { &Update<M>... };
+}
+
+template<uint... M>
+static constexpr std::array<ParticleUpdateKernel, sizeof...(M)> MakeUpdateScalarTable(std::integer_sequence<uint, M...>)
+{
+	return { &UpdateScalar<M>... };
+}
+
+static constexpr auto updateTable = MakeUpdateTable(std::make_integer_sequence<uint, PARTICLE_MODULES>());
+static constexpr auto updateScalarTable = MakeUpdateScalarTable(std::make_integer_sequence<uint, PARTICLE_MODULES>());
+
+ParticleUpdateKernel ParticleKernels::GetUpdate(uint modules)
+{
+	return updateTable[modules & (PARTICLE_MODULES - 1)];
+}
+
+ParticleUpdateKernel ParticleKernels::GetUpdateScalar(uint modules)
+{
+	return updateScalarTable[modules & (PARTICLE_MODULES - 1)];
+}
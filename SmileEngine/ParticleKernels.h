@@ -0,0 +1,95 @@
+#pragma once
+
+#include "SmileSetup.h"
+#include "MathGeoLib/include/Math/float2.h"
+#include "MathGeoLib/include/Math/float3.h"
+#include "MathGeoLib/include/Math/float4.h"
+#include "MathGeoLib/include/Geometry/AABB.h"
+#include <vector>
+#include <cstdint>
+
+// SSE2 is on by default in 32 bit MSVC builds (/arch:SSE2), AVX needs /arch:AVX
+#if defined(__AVX__)
+#define PARTICLE_AVX
+#endif
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARTICLE_SSE
+#endif
+
+// ----------------------------------------------------------------- [ParticleBuffer]
+// An emitter's particles as structure of arrays: each update kernel streams through the few floats it touches.
+// A particle is alive while its life is above 0. Dead slots are updated too (it is cheaper than skipping them),
+// and their values mean nothing until the slot is spawned again.
+// The free slots are a stack: taking one is O(1). The ones that die go back to it in Reclaim(), once a frame
+struct ParticleBuffer
+{
+	std::vector<float> posX, posY, posZ; // world
+	std::vector<float> speedX, speedY, speedZ;
+	std::vector<float> life, lifeTime; // left, and lived
+	std::vector<float> size;
+	std::vector<float> colorR, colorG, colorB, colorA;
+	std::vector<uint> tile;
+	std::vector<float> tileTime;
+	std::vector<float> camDist; // squared: the draw order
+
+	std::vector<uint> freeSlots; // the last one goes first
+	std::vector<uint8_t> inUse; // taken and not reclaimed yet
+
+	void Resize(uint count); // keeps what fits
+	void Clear();
+	uint Size() const { return life.size(); };
+	uint GetFreeCount() const { return freeSlots.size(); };
+
+	uint Allocate(); // a free slot, marked in use. There must be one (see GetFreeCount)
+	void Reclaim(); // the slots in use whose particle died are free again
+	void RebuildFreeSlots(); // from the lives, e.g. once they are loaded
+	void FindOldest(uint count, std::vector<uint>& out) const; // appends the (up to) count alive ones that lived the longest
+	math::AABB GetLiveBounds(float reach) const; // the alive ones, padded by their size times reach. Not finite if none
+	bool IsAlive(uint i) const { return life[i] > 0.f; };
+	float3 GetPosition(uint i) const { return float3(posX[i], posY[i], posZ[i]); };
+	float4 GetColor(uint i) const { return float4(colorR[i], colorG[i], colorB[i], colorA[i]); };
+	void SetPosition(uint i, const float3& pos) { posX[i] = pos.x; posY[i] = pos.y; posZ[i] = pos.z; };
+	void SetSpeed(uint i, const float3& speed) { speedX[i] = speed.x; speedY[i] = speed.y; speedZ[i] = speed.z; };
+	void SetColor(uint i, const float4& color) { colorR[i] = color.x; colorG[i] = color.y; colorB[i] = color.z; colorA[i] = color.w; };
+};
+
+// What the particles are drawn with: 4 (a quad) each, in world space
+struct ParticleVertex
+{
+	float3 pos;
+	float2 uv;
+	float4 color;
+};
+
+// ----------------------------------------------------------------- [ParticleUpdate]
+// What an emitter changes over the particles' life, besides life and position. Each combination has its own kernel
+enum PARTICLE_MODULE : uint
+{
+	PARTICLE_GRAVITY = 1 << 0,
+	PARTICLE_SIZE = 1 << 1, // over life
+	PARTICLE_COLOR = 1 << 2, // over life
+	PARTICLE_FLIPBOOK = 1 << 3, // texture tiles
+	PARTICLE_MODULES = 1 << 4 // combinations
+};
+
+struct ParticleUpdateParams
+{
+	float decay = 0.f, gravity = 0.f, initialLife = 1.f;
+	float sizeFrom = 1.f, sizeTo = 1.f;
+	float4 colorFrom = float4::zero, colorTo = float4::zero;
+	float tileTime = 0.f; // per tile
+	uint maxTiles = 0;
+};
+
+typedef void (*ParticleUpdateKernel)(ParticleBuffer& p, const ParticleUpdateParams& params, float dt, uint first, uint last); // [first, last)
+
+// ----------------------------------------------------------------- [ParticleKernels]
+// The update kernels are instantiated at compile time for each combination of modules: a single loop over a range
+// of the buffer that updates everything of a particle, with the modules off compiled out. Ranges that do not overlap
+// can be updated at once. The wide versions do 4 (SSE) or 8 (AVX) particles at once and leave the tail to the scalar one
+class ParticleKernels
+{
+public:
+	static ParticleUpdateKernel GetUpdate(uint modules); // the widest available
+	static ParticleUpdateKernel GetUpdateScalar(uint modules);
+};
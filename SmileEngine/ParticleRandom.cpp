@@ -0,0 +1,80 @@
+#include "ParticleRandom.h"
+
+// The 24 high bits: as many as a float holds, so they are all equally likely and 1 is never reached
+static inline float ToUnit(uint32_t bits)
+{
+	return (float)(bits >> 8) * (1.f / 16777216.f);
+}
+
+ParticleRandom::ParticleRandom(uint64_t seed, uint64_t stream)
+{
+	Seed(seed, stream);
+}
+
+void ParticleRandom::Seed(uint64_t seed, uint64_t stream)
+{
+	for (uint l = 0; l < RANDOM_LANES; ++l)
+		lanes[l].seed(seed, stream * RANDOM_LANES + l);
+	next = 0;
+}
+
+// -----------------------------------------------------------------
+float ParticleRandom::Next()
+{
+	float ret = ToUnit(lanes[next]());
+	next = (next + 1) % RANDOM_LANES;
+	return ret;
+}
+
+float ParticleRandom::Range(float from, float to)
+{
+	return from + Next() * (to - from);
+}
+
+// ----------------------------------------------------------------- [Fill]
+void ParticleRandom::Fill(float* out, uint count, float from, float to)
+{
+	Fill(out, count, &from, &to, 1);
+}
+
+void ParticleRandom::Fill(float3* out, uint count, const float3& from, const float3& to)
+{
+	Fill(out->ptr(), count * 3, from.ptr(), to.ptr(), 3);
+}
+
+void ParticleRandom::Fill(float4* out, uint count, const float4& from, const float4& to)
+{
+	Fill(out->ptr(), count * 4, from.ptr(), to.ptr(), 4);
+}
+
+void ParticleRandom::Fill(float* out, uint count, const float* from, const float* to, uint period)
+{
+	float base[4], range[4]; // up to a float4
+	for (uint c = 0; c < period; ++c)
+	{
+		base[c] = from[c];
+		range[c] = to[c] - from[c];
+	}
+
+	// 1) A number from each lane at a time: the lanes do not wait on each other
+	uint i = 0, c = 0;
+	for (; i + RANDOM_LANES <= count; i += RANDOM_LANES)
+	{
+		uint32_t bits[RANDOM_LANES];
+		for (uint l = 0; l < RANDOM_LANES; ++l)
+			bits[l] = lanes[l]();
+
+		for (uint l = 0; l < RANDOM_LANES; ++l)
+		{
+			out[i + l] = base[c] + ToUnit(bits[l]) * range[c];
+			c = (c + 1 == period) ? 0 : c + 1;
+		}
+	}
+
+	// 2) The rest, one by one
+	for (; i < count; ++i)
+	{
+		out[i] = base[c] + Next() * range[c];
+		c = (c + 1 == period) ? 0 : c + 1;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "SmileSetup.h"
+#include "MathGeoLib/include/Math/float3.h"
+#include "MathGeoLib/include/Math/float4.h"
+#include "pcg/include/pcg_random.hpp"
+#include <cstdint>
+
+#define RANDOM_LANES 4 // pcg32s stepped side by side: each one waits on its own multiply only
+
+// ----------------------------------------------------------------- [ParticleRandom]
+// Uniform floats, in batches: spawning asks for all it needs at once, one call per value (see ParticleSimulation).
+// Its lanes are pcg32 streams of their own, picked from the seed and stream given: two emitters on different streams
+// never draw the same numbers, and each one draws the same ones on every run, on whatever thread it is updated
+class ParticleRandom
+{
+public:
+	ParticleRandom(uint64_t seed = 0u, uint64_t stream = 0u);
+	void Seed(uint64_t seed, uint64_t stream = 0u); // from the start again
+
+	float Next(); // [0, 1)
+	float Range(float from, float to); // [from, to)
+
+	// count of them, each in [from, to), per component
+	void Fill(float* out, uint count, float from, float to);
+	void Fill(float3* out, uint count, const float3& from, const float3& to);
+	void Fill(float4* out, uint count, const float4& from, const float4& to);
+
+private:
+	void Fill(float* out, uint count, const float* from, const float* to, uint period); // out[i] in the range i % period
+
+private:
+	pcg32 lanes[RANDOM_LANES];
+	uint next = 0; // the lane for the next number on its own
+};
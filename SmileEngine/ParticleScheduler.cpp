@@ -0,0 +1,123 @@
+#include "ParticleScheduler.h"
+#include "ComponentParticleEmitter.h"
+#include "MathGeoLib/include/Math/MathFunc.h"
+
+ParticleScheduler::~ParticleScheduler()
+{
+	StopWorkers();
+}
+
+void ParticleScheduler::Add(ComponentParticleEmitter* emitter, float dt)
+{
+	if (emitter->PrepareUpdate(dt) == false)
+		finished.push_back(emitter);
+	else if (emitter->GetStepTime() > 0.f)
+		emitters.push_back(emitter);
+}
+
+void ParticleScheduler::Run()
+{
+	if (started == false)
+	{
+		started = true;
+		SetThreadCount(Max(std::thread::hardware_concurrency(), 1u) - 1);
+	}
+
+	// 1) Simulate: every emitter's chunks
+	tasks.clear();
+	uint total = 0;
+	for (auto& emitter : emitters)
+	{
+		uint count = emitter->GetParticleCount();
+		for (uint first = 0; first < count; first += PARTICLE_CHUNK)
+			tasks.push_back({ emitter, first, Min(first + PARTICLE_CHUNK, count) });
+		total += count;
+	}
+
+	bool serial = total <= PARTICLE_CHUNK;
+	ParallelFor(tasks.size(), [this](uint i) { tasks[i].emitter->SimulateRange(tasks[i].first, tasks[i].last); }, serial);
+
+	// 2) Finish: each emitter whole
+	ParallelFor(emitters.size(), [this](uint i) { emitters[i]->FinishUpdate(); }, serial);
+
+	// 3) Commit
+	for (auto& emitter : emitters)
+		emitter->CommitUpdate();
+	for (auto& emitter : finished)
+		emitter->CommitFinish();
+
+	emitters.clear();
+	finished.clear();
+}
+
+void ParticleScheduler::SetThreadCount(uint count)
+{
+	started = true;
+	StopWorkers();
+	for (uint i = 0; i < count; ++i)
+		workers.emplace_back(&ParticleScheduler::Work, this, generation);
+}
+
+// The calling thread works too, and waits for the rest
+void ParticleScheduler::ParallelFor(uint count, const std::function<void(uint)>& job, bool serial)
+{
+	if (serial || count <= 1 || workers.empty())
+	{
+		for (uint i = 0; i < count; ++i)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		jobCount = count;
+		next = 0;
+		busy = workers.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	for (uint i; (i = next++) < count;)
+		job(i);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return busy == 0; });
+	this->job = nullptr;
+}
+
+// "seen": the last job when it was created, it may start after the next one
+void ParticleScheduler::Work(uint seen)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [&]() { return stop || generation != seen; });
+		if (stop)
+			return;
+		seen = generation;
+
+		const std::function<void(uint)>& current = *job;
+		uint count = jobCount;
+		lock.unlock();
+		for (uint i; (i = next++) < count;)
+			current(i);
+		lock.lock();
+
+		if (--busy == 0)
+			done.notify_one();
+	}
+}
+
+void ParticleScheduler::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+	stop = false;
+}
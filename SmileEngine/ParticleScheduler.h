@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SmileSetup.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#define PARTICLE_CHUNK 2048 // particles per task: bigger emitters are split. Frames with fewer in total run on one thread
+
+class ComponentParticleEmitter;
+
+struct ParticleTask
+{
+	ComponentParticleEmitter* emitter = nullptr;
+	uint first = 0, last = 0; // [first, last)
+};
+
+// ----------------------------------------------------------------- [ParticleScheduler]
+// Updates the frame's emitters in parallel, once the scene's objects are updated. Emitters queue themselves in their
+// Update(), then Run():
+// 1) Simulates them, in chunks (any thread). Emitters with nothing to simulate this frame (LOD) are left out
+// 2) Finishes each one: the dead out, the new in (any thread)
+// 3) Commits what touches the scene: the objects' bounds, the emitters that expired (the calling thread, in the
+// order they were queued)
+// A task only writes its emitter, and each emitter has its own random generator: the results do not depend on the
+// thread count
+class ParticleScheduler
+{
+public:
+	~ParticleScheduler();
+
+	void Add(ComponentParticleEmitter* emitter, float dt);
+	void Run();
+
+	void SetThreadCount(uint count); // workers besides the calling thread. 0: all on it
+	uint GetThreadCount() const { return workers.size(); };
+
+private:
+	void ParallelFor(uint count, const std::function<void(uint)>& job, bool serial); // job(0 ... count - 1)
+	void Work(uint seen);
+	void StopWorkers();
+
+private:
+	std::vector<ComponentParticleEmitter*> emitters, finished;
+	std::vector<ParticleTask> tasks;
+
+	bool started = false;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	const std::function<void(uint)>* job = nullptr;
+	uint jobCount = 0, generation = 0, busy = 0;
+	std::atomic<uint> next = 0;
+	bool stop = false;
+};
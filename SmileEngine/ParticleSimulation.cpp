@@ -0,0 +1,283 @@
+#include "ParticleSimulation.h"
+#include "MathGeoLib/include/Math/MathFunc.h"
+#include <algorithm>
+
+ParticleSimulation::ParticleSimulation(AllData& data, uint64_t seed, uint64_t stream) : data(data), random(seed, stream)
+{
+}
+
+void ParticleSimulation::Resize(uint count)
+{
+	particles.Resize(count);
+}
+
+void ParticleSimulation::Clear()
+{
+	particles.Clear();
+	spawnSlots.clear();
+}
+
+void ParticleSimulation::Restart()
+{
+	std::fill(particles.life.begin(), particles.life.end(), 0.f);
+	particles.RebuildFreeSlots();
+	spawnSlots.clear();
+	burst = false;
+	liveBounds = math::AABB(float3::inf, -float3::inf);
+}
+
+// -----------------------------------------------------------------
+void ParticleSimulation::Prepare(const float3& origin, float quadSize, float spawnScale)
+{
+	this->origin = origin;
+	this->spawnScale = spawnScale;
+	cornerReach = quadSize * 0.5f * math::Sqrt(2.f);
+
+	// The kernel for the modules on. Picked again only once the emitter is set up otherwise
+	uint modules = GetUpdateModules();
+	if (modules != updateModules || updateKernel == nullptr)
+		updateKernel = ParticleKernels::GetUpdate(updateModules = modules);
+	updateParams = GetUpdateParams();
+}
+
+void ParticleSimulation::SimulateRange(float dt, uint first, uint last)
+{
+	updateKernel(particles, updateParams, dt, first, last);
+}
+
+void ParticleSimulation::Finish(float dt)
+{
+	particles.Reclaim();
+
+	// Spawn new particles
+	spawnSlots.clear();
+	if (data.emissionData.burstTime > 0.f)
+		BurstAction(dt);
+	else
+		DefaultSpawnAction(dt);
+
+	liveBounds = particles.GetLiveBounds(cornerReach);
+}
+
+void ParticleSimulation::Step(float dt)
+{
+	SimulateRange(dt, 0, particles.Size());
+	Finish(dt);
+}
+
+// -----------------------------------------------------------------
+void ParticleSimulation::Sort(const float3& camPos)
+{
+	bool sort = data.blendmode != blendMode::ADDITIVE;
+	if (sort)
+		for (uint i = 0; i < particles.Size(); ++i)
+			if (particles.IsAlive(i))
+				particles.camDist[i] = (particles.GetPosition(i) - camPos).LengthSq();
+	drawOrder.Sort(particles, sort);
+}
+
+// ----------------------------------------------------------------- [Spawn]
+void ParticleSimulation::BurstAction(float dt)
+{
+	if ((data.emissionData.currentBurstTime += dt) >= data.emissionData.burstTime)
+	{
+		data.emissionData.currentBurstTime = 0;
+		burst = !burst;
+	}
+
+	if (burst == false)
+		DefaultSpawnAction(dt);
+}
+
+void ParticleSimulation::DefaultSpawnAction(float dt)
+{
+	// As many as the rate asks for, not one a frame at most. The time left carries over
+	EmissionData& emission = data.emissionData;
+	float period = emission.time / spawnScale;
+	if (period <= 0.f || (emission.currenTime += dt) < period)
+		return;
+
+	uint count = (uint)(emission.currenTime / period);
+	emission.currenTime -= count * period;
+	SpawnParticles(Min(count, particles.Size()));
+}
+
+void ParticleSimulation::SpawnParticles(uint count)
+{
+	// 1) Free slots first. If there are not enough, the pool policy
+	while (spawnSlots.size() < count && particles.GetFreeCount() > 0)
+		spawnSlots.push_back(particles.Allocate());
+
+	if (spawnSlots.size() < count && data.emissionData.fullPool == fullPoolPolicy::REPLACE_OLDEST)
+		particles.FindOldest(count - (uint)spawnSlots.size(), spawnSlots);
+
+	// 2) Spawn them all, a value at a time. The random ones are drawn all at once
+	const InitialState& state = data.initialState;
+	for (uint i : spawnSlots)
+	{
+		particles.life[i] = state.life.first;
+		particles.lifeTime[i] = 0.f;
+		particles.size[i] = state.size.first;
+	}
+
+	if (data.emissionData.randomColor)
+	{
+		spawnValues4.resize(spawnSlots.size());
+		random.Fill(spawnValues4.data(), spawnSlots.size(), float4::zero, float4::one);
+		for (uint n = 0; n < spawnSlots.size(); ++n)
+			particles.SetColor(spawnSlots[n], spawnValues4[n]);
+	}
+	else
+		for (uint i : spawnSlots)
+			particles.SetColor(i, state.color.first);
+
+	SetSpawnSpeeds();
+	SetSpawnPositions();
+}
+
+void ParticleSimulation::SetSpawnSpeeds()
+{
+	const auto& randomSpeed = data.emissionData.randomSpeed;
+	if (randomSpeed.first == false)
+	{
+		for (uint i : spawnSlots)
+			particles.SetSpeed(i, data.initialState.speed);
+		return;
+	}
+
+	// Between the two, or around 0 as wide as the first
+	float3 from = randomSpeed.second.first, to = randomSpeed.second.second;
+	if (to.IsFinite() == false)
+	{
+		to = from.Abs() / 2;
+		from = -to;
+	}
+
+	spawnValues3.resize(spawnSlots.size());
+	random.Fill(spawnValues3.data(), spawnSlots.size(), from, to);
+	for (uint n = 0; n < spawnSlots.size(); ++n)
+		particles.SetSpeed(spawnSlots[n], spawnValues3[n]);
+}
+
+void ParticleSimulation::SetSpawnPositions()
+{
+	// World: around the origin, as wide as the radius. The cone's all start at it
+	emmissionShape shape = data.emissionData.shape;
+	if (shape != emmissionShape::CIRCLE && shape != emmissionShape::SPHERE)
+	{
+		for (uint i : spawnSlots)
+			particles.SetPosition(i, origin);
+		return;
+	}
+
+	float3 reach = data.emissionData.spawnRadius.Abs() / 2;
+	if (shape == emmissionShape::CIRCLE)
+		reach.y = 0.f;
+
+	spawnValues3.resize(spawnSlots.size());
+	random.Fill(spawnValues3.data(), spawnSlots.size(), origin - reach, origin + reach);
+	for (uint n = 0; n < spawnSlots.size(); ++n)
+		particles.SetPosition(spawnSlots[n], spawnValues3[n]);
+}
+
+// ----------------------------------------------------------------- Update Values
+uint ParticleSimulation::GetUpdateModules() const
+{
+	uint modules = 0;
+	const InitialState& state = data.initialState;
+
+	if (data.emissionData.gravity)
+		modules |= PARTICLE_GRAVITY;
+	if (state.size.first != state.size.second)
+		modules |= PARTICLE_SIZE;
+	// c = init + inverse percentage * range. A random color stays as it is
+	if (data.emissionData.randomColor == false && state.color.first.IsFinite() && state.color.second.IsFinite()
+		&& state.color.first.Equals(state.color.second) == false)
+		modules |= PARTICLE_COLOR;
+	if (state.tex.second > 0.f)
+		modules |= PARTICLE_FLIPBOOK;
+
+	return modules;
+}
+
+ParticleUpdateParams ParticleSimulation::GetUpdateParams() const
+{
+	ParticleUpdateParams params;
+	const InitialState& state = data.initialState;
+
+	params.decay = state.life.second;
+	params.gravity = GLOBAL_GRAVITY; // the more they live, the harder
+	params.initialLife = state.life.first;
+	params.sizeFrom = state.size.first;
+	params.sizeTo = state.size.second;
+	if (updateModules & PARTICLE_COLOR)
+	{
+		params.colorFrom = state.color.first;
+		params.colorTo = state.color.second;
+	}
+	params.tileTime = state.tex.second;
+	params.maxTiles = (updateModules & PARTICLE_FLIPBOOK) ? data.tiles.maxTiles : 0;
+
+	return params;
+}
+
+// ----------------------------------------------------------------- [ParticlePresets]
+AllData ParticlePresets::Get(particleEffect effect, ParticleRandom& random)
+{
+	switch (effect)
+	{
+	case particleEffect::SMOKE:
+		return Smoke();
+	case particleEffect::FIREWORK:
+		return FireWork(random);
+	default:
+		return AllData();
+	}
+}
+
+AllData ParticlePresets::Smoke()
+{
+	AllData data;
+	data.initialState.life = std::pair(0.5f, 0.2f);
+	data.emissionData.time = 0.03f;
+	data.emissionData.maxParticles = 1000;
+	data.emissionData.randomSpeed = std::pair(true, std::pair(float3(-0.5f, 2.f, -0.5f), float3(0.5f, 2.f, 0.5f)));
+	data.emissionData.texPath = LIBRARY_TEXTURES_FOLDER_A + std::string("smokesheet.dds");
+	data.initialState.tex = std::pair(true, 0.1f);
+	data.tiles.nRows = data.tiles.nCols = 7;
+	data.tiles.maxTiles = 46;
+	data.emissionData.burstTime = 1.f;
+	data.emissionData.gravity = false;
+	data.initialState.color.first = float4(0.2f, 0.2f, 0.2f, 0.5f);
+	data.initialState.color.second = float4(0.8f, 0.8f, 0.8f, 0.5f);
+
+	return data;
+}
+
+AllData ParticlePresets::FireWork(ParticleRandom& random)
+{
+	AllData data;
+
+	data.initialState.life.first = 0.4f;
+	data.initialState.life.second = random.Range(0.6f, 1.f);
+
+	float variantSize = random.Range(0.f, 1.5f);
+	data.initialState.size.first = 0.5f;
+	data.initialState.size.second = 0.5f + variantSize;
+
+	data.emissionData.randomSpeed.first = true;
+	float variantSp = random.Range(-5.f, 5.f);
+	data.emissionData.randomSpeed.second.first = float3(23 + variantSp, 23 + variantSp, 5 + variantSp);
+
+	data.emissionData.gravity = true;
+	data.emissionData.time = 0.001;
+
+	for (int i = 0; i < 3; ++i)
+		data.initialState.color.first[i] = random.Range(0.f, 1.f);
+	data.initialState.color.first[3] = 1.f;
+	for (int i = 0; i < 3; ++i)
+		data.initialState.color.second[i] = random.Range(0.f, 1.f);
+	data.initialState.color.second[3] = 0.f;
+
+	return data;
+}
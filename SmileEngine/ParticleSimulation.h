@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <cstdint>
+
+#include "MathGeoLib/include/Math/float3.h"
+#include "MathGeoLib/include/Math/float4.h"
+
+#include "ParticleKernels.h"
+#include "ParticleSorter.h"
+#include "ParticleRandom.h"
+
+struct InitialState
+{
+	// This Variables will be updated each frame if they have value over time (Current order: 0->5)
+	std::pair<float, float> life = std::pair(1.f, 1.f);
+	float3 speed = float3(0, 1, 0); // default
+	std::pair<float, float> size = std::pair(1.f, 1.f); // initial & final
+	float transparency = 0.f;
+	std::pair<float4, float4> color = std::pair(float4::inf, float4::inf); // initial & final
+	std::pair<bool, float> tex = std::pair(false, 0.f); // has & anim speed
+
+};
+
+struct TileData
+{
+	uint nRows = 0, nCols = 0, maxTiles = 0;
+
+public:
+	inline void Reset()
+	{
+		nRows = nCols = maxTiles = 0;
+	}
+	inline bool isValid() const
+	{
+		return ((nRows > 0) && (nCols > 0) && (maxTiles > 0));
+	}
+};
+
+enum class emmissionShape { CIRCLE, SPHERE, CONE };
+enum class blendMode { ADDITIVE, ALPHA_BLEND };
+enum class fullPoolPolicy { SKIP, REPLACE_OLDEST }; // what to do with the particles that do not fit
+
+struct EmissionData
+{
+	bool gravity = true;
+	uint maxParticles = 100;
+	std::string texPath = "empty";
+	std::pair<bool, std::pair<float3, float3>> randomSpeed = std::pair(false, std::pair(float3::inf, float3::inf));
+	bool randomColor = false;
+	float time = 0.5f, burstTime = 0.f, currenTime = 0.f,
+		currentBurstTime = 0.f, expireTime = 0.f, totalTime = 0.f;
+	float3 spawnRadius = float3(5.f); // the radius or inner + outer
+	emmissionShape shape = emmissionShape::CONE;
+	fullPoolPolicy fullPool = fullPoolPolicy::SKIP;
+	bool lod = true;
+	float lodDistance = 30.f; // to the camera: farther is REDUCED
+};
+
+// This struct has it all:
+struct AllData
+{
+	// Generation
+	EmissionData emissionData;
+
+	// Initial State
+	InitialState initialState;
+	// Modes
+	blendMode blendmode = blendMode::ALPHA_BLEND;
+	TileData tiles; // the texture's sheet, if it is one
+
+};
+
+#define GLOBAL_GRAVITY 0.5f
+
+// ----------------------------------------------------------------- [ParticleSimulation]
+// An emitter's particles as simulated: spawn, update and sort, with nothing of GL or the scene. What it needs from
+// them (where to spawn, the quad's size) is given each step, so it also runs headless (see Benchmarks)
+class ParticleSimulation
+{
+public:
+	ParticleSimulation(AllData& data, uint64_t seed, uint64_t stream = 0u); // the data stays its owner's, and is read each step
+
+	void Resize(uint count); // keeps what fits
+	void Clear();
+	void Restart(); // all of them dead, as new. Keeps the memory
+
+	// A step: Prepare, the ranges (at once, see ParticleScheduler), then Finish. Or Prepare, then Step
+	void Prepare(const float3& origin, float quadSize, float spawnScale = 1.f); // scale: of the spawn rate
+	void SimulateRange(float dt, uint first, uint last); // [first, last)
+	void Finish(float dt); // the dead out, the new in
+	void Step(float dt); // all of it, here
+
+	void Sort(const float3& camPos); // the draw order, back to front. All of them as they are if the blending does not mind
+
+	const ParticleSorter& GetDrawOrder() const { return drawOrder; };
+	const math::AABB& GetLiveBounds() const { return liveBounds; }; // padded by the quads. Not finite if none
+	uint GetSpawnCount() const { return spawnSlots.size(); }; // the last step's
+	uint GetUpdateModules() const; // from the data, as it is now
+
+private:
+	// Spawn
+	void SpawnParticles(uint count);
+	void BurstAction(float dt);
+	void DefaultSpawnAction(float dt);
+	void SetSpawnSpeeds();
+	void SetSpawnPositions();
+
+	ParticleUpdateParams GetUpdateParams() const;
+
+public:
+	ParticleBuffer particles;
+
+private:
+	AllData& data;
+	std::vector<uint> spawnSlots; // the last step's
+	std::vector<float3> spawnValues3; // a random value for each of them
+	std::vector<float4> spawnValues4;
+	ParticleSorter drawOrder;
+	uint updateModules = 0;
+	ParticleUpdateKernel updateKernel = nullptr; // specialised on the modules on
+	ParticleUpdateParams updateParams; // this step's
+	ParticleRandom random; // its own stream: updated on any thread, the same
+	bool burst = false;
+
+	// This step's
+	float3 origin = float3::zero;
+	float spawnScale = 1.f;
+	float cornerReach = 0.f; // a quad corner's farthest from its particle, for size 1
+	math::AABB liveBounds = math::AABB(float3::inf, -float3::inf);
+};
+
+// ----------------------------------------------------------------- [ParticlePresets]
+// The scene's built-in effects, as data. Where they go is up to the caller
+enum class particleEffect { NONE, SMOKE, FIREWORK, MAX };
+
+class ParticlePresets
+{
+public:
+	static AllData Get(particleEffect effect, ParticleRandom& random);
+	static AllData Smoke();
+	static AllData FireWork(ParticleRandom& random); // each one a bit different
+};
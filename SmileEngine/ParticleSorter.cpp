@@ -0,0 +1,87 @@
+#include "ParticleSorter.h"
+#include <cstring>
+
+// Positive floats sort like their bits
+static inline uint DistanceKey(float distance)
+{
+	uint bits;
+	memcpy(&bits, &distance, sizeof(bits));
+	return ~bits;
+}
+
+void ParticleSorter::Sort(const ParticleBuffer& p, bool needed)
+{
+	Refresh(p);
+	insertion = false;
+	if (needed == false)
+		return;
+
+	uint unsorted = 0;
+	for (uint i = 1; i < items.size(); ++i)
+		if (items[i - 1].key > items[i].key)
+			++unsorted;
+
+	if (unsorted == 0)
+		return;
+	if (unsorted * PARTICLE_SORT_NEARLY <= items.size())
+	{
+		insertion = true;
+		InsertionSort(items);
+	}
+	else
+		RadixSort(items, temp);
+}
+
+// The dead (or gone, if the pool shrank) out, the new ones at the end. Keys from camDist
+void ParticleSorter::Refresh(const ParticleBuffer& p)
+{
+	listed.resize(p.Size(), false);
+
+	uint kept = 0;
+	for (uint i = 0; i < items.size(); ++i)
+	{
+		uint index = items[i].index;
+		if (index < p.Size() && p.IsAlive(index))
+			items[kept++] = { DistanceKey(p.camDist[index]), index };
+		else if (index < p.Size())
+			listed[index] = false;
+	}
+	items.resize(kept);
+
+	for (uint i = 0; i < p.Size(); ++i)
+	{
+		if (p.IsAlive(i) && listed[i] == false)
+		{
+			listed[i] = true;
+			items.push_back({ DistanceKey(p.camDist[i]), i });
+		}
+	}
+}
+
+void ParticleSorter::InsertionSort(std::vector<ParticleSortItem>& items)
+{
+	for (uint i = 1; i < items.size(); ++i)
+	{
+		ParticleSortItem item = items[i];
+		uint j = i;
+		for (; j > 0 && items[j - 1].key > item.key; --j)
+			items[j] = items[j - 1];
+		items[j] = item;
+	}
+}
+
+void ParticleSorter::RadixSort(std::vector<ParticleSortItem>& items, std::vector<ParticleSortItem>& temp)
+{
+	temp.resize(items.size());
+	for (uint shift = 0; shift < 32; shift += 8)
+	{
+		uint offsets[257] = { 0 };
+		for (auto& item : items)
+			offsets[((item.key >> shift) & 0xFF) + 1]++;
+		for (uint i = 1; i < 257; ++i)
+			offsets[i] += offsets[i - 1];
+		for (auto& item : items)
+			temp[offsets[(item.key >> shift) & 0xFF]++] = item;
+		items.swap(temp);
+	}
+}
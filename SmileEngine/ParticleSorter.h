@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ParticleKernels.h"
+
+#define PARTICLE_SORT_NEARLY 64 // at most one out of order neighbour in this many: an insertion pass, cheaper than a radix sort
+
+struct ParticleSortItem
+{
+	uint key; // the distance's bits, flipped: the farthest first
+	uint index;
+};
+
+// ----------------------------------------------------------------- [ParticleSorter]
+// An emitter's draw order: its live particles, back to front by camDist. Only (key, index) pairs are sorted.
+// Last frame's order is kept and patched (the dead out, the new at the end): if it is nearly right an insertion pass
+// fixes it, otherwise it is radix sorted
+class ParticleSorter
+{
+public:
+	void Sort(const ParticleBuffer& p, bool needed = true); // if not needed (order independent blending), just the live ones
+
+	uint Size() const { return items.size(); };
+	uint operator[](uint i) const { return items[i].index; };
+	bool WasInsertion() const { return insertion; }; // last Sort()
+
+private:
+	void Refresh(const ParticleBuffer& p);
+	static void InsertionSort(std::vector<ParticleSortItem>& items);
+	static void RadixSort(std::vector<ParticleSortItem>& items, std::vector<ParticleSortItem>& temp);
+
+private:
+	std::vector<ParticleSortItem> items, temp;
+	std::vector<uint8_t> listed; // per slot: in items
+	bool insertion = false;
+};
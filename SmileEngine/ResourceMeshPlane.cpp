@@ -1,6 +1,7 @@
 #include "ResourceMeshPlane.h"
 #include "Glew/include/GL/glew.h" 
 #include "ResourceTexture.h"
+#include <cstddef>
 
 ResourceMeshPlane::ResourceMeshPlane(SmileUUID uuid, ownMeshType type, std::string path, float4 color, TileData* tileData, float size) : ResourceMesh(uuid, type, path), color(color), tileData(tileData), size(size)
 {
@@ -39,6 +40,10 @@ void ResourceMeshPlane::FreeMemory()
 	if(tileData)
 		RELEASE(tileData);
 
+	if (id_stream != 0)
+		glDeleteBuffers(1, (GLuint*)&id_stream);
+	id_stream = streamSize = 0;
+
 	/*glDeleteBuffers(1, (GLuint*)&bufferData.color);
 	RELEASE_ARRAY(bufferData.color);*/
 }
@@ -131,6 +136,85 @@ void ResourceMeshPlane::BlitMeshHere(float4x4& global_transform, bool& needTileU
 	glPopMatrix();
 }
 
+// One draw call and one state setup for all the quads
+void ResourceMeshPlane::BlitParticles(const std::vector<ParticleVertex>& vertices, ResourceTexture* tex, blendMode blendMode, float transparency)
+{
+	if (vertices.empty())
+		return; 
+
+	// Stream the vertices: a new store each frame (the GPU may still be reading the last one), as big as the biggest batch
+	uint bytes = sizeof(ParticleVertex) * vertices.size(); 
+	if (id_stream == 0)
+		glGenBuffers(1, (GLuint*) & (id_stream));
+	glBindBuffer(GL_ARRAY_BUFFER, id_stream);
+	streamSize = Max(streamSize, bytes); 
+	glBufferData(GL_ARRAY_BUFFER, streamSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertices.data());
+
+	// Cient states
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(ParticleVertex), (void*)offsetof(ParticleVertex, pos));
+	glColorPointer(4, GL_FLOAT, sizeof(ParticleVertex), (void*)offsetof(ParticleVertex, color));
+
+	// Texture
+	if (tex)
+	{
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(ParticleVertex), (void*)offsetof(ParticleVertex, uv));
+
+		glEnable(GL_ALPHA_TEST);
+		glBindTexture(GL_TEXTURE_2D, tex->GetTextureData()->id_texture);
+		// Alpha Testing
+		glAlphaFunc(GL_GREATER, (GLclampf)transparency);
+	}
+	else
+	{
+		// Color Blending
+		glEnable(GL_BLEND);
+		if (blendMode == blendMode::ADDITIVE)
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		else if (blendMode == blendMode::ALPHA_BLEND)
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	// Geometry
+	glDrawArrays(GL_QUADS, 0, vertices.size());
+
+	// Disable Cient states && clear data
+	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+	glAlphaFunc(GL_EQUAL, (GLclampf)1.f);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_BLEND);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ResourceMeshPlane::GetTileUvs(const TileData& tiles, uint tileIndex, float2 uvs[4]) const
+{
+	if (tileIndex == INFINITE || tiles.isValid() == false)
+	{
+		for (uint i = 0; i < 4; ++i)
+			uvs[i] = float2(own_mesh->initialUvCoords[i * 2], own_mesh->initialUvCoords[i * 2 + 1]);
+		return; 
+	}
+
+	// Same as UpdateTileUvs()
+	uint row = tileIndex / tiles.nCols;
+	uint col = tileIndex % tiles.nCols;
+
+	float sizeX = 1 / (float)(int)tiles.nCols;
+	float sizeY = 1 / (float)(int)tiles.nRows;
+
+	uvs[0] = float2(col * sizeX, row * sizeY);
+	uvs[1] = float2(col * sizeX, (row + 1) * sizeY);
+	uvs[2] = float2((col + 1) * sizeX, (row + 1) * sizeY);
+	uvs[3] = float2((col + 1) * sizeX, row * sizeY);
+}
+
 void ResourceMeshPlane::UpdateTileUvs(bool& needTileUpdate, uint tileIndex)
 {
 	if (tileData->isValid() == false)
@@ -15,21 +15,6 @@ struct bufferData
 
 };
 
-struct TileData
-{
-	uint nRows = 0, nCols = 0, maxTiles = 0; 
-
-public: 
-	inline void Reset()
-	{
-		nRows = nCols = maxTiles = 0; 
-	}
-	inline bool isValid()
-	{
-		return ((nRows > 0) && (nCols > 0) && (maxTiles > 0)); 
-	}
-};
-
 class ResourceMeshPlane : public ResourceMesh
 {
 public:
@@ -40,6 +25,10 @@ public:
 
 	void GenerateOwnMeshData(float size = 0);
 	void BlitMeshHere(float4x4& global_transform, bool& needTileUpdate, ResourceTexture* tex = nullptr, blendMode blendMode = blendMode::ALPHA_BLEND, float transparency = 0.f, float4 color = float4::inf, uint tileIndex = INFINITE);
+	void BlitParticles(const std::vector<ParticleVertex>& vertices, ResourceTexture* tex = nullptr, blendMode blendMode = blendMode::ALPHA_BLEND, float transparency = 0.f); // all at once
+
+	float GetQuadSize() const { return own_mesh->size; };
+	void GetTileUvs(const TileData& tiles, uint tileIndex, float2 uvs[4]) const; // in the points' order. The whole texture if there is no such tile
 	
 private: 
 	void UpdateTileUvs(bool& needTileUpdate, uint tileIndex);
@@ -48,6 +37,7 @@ public:
 	TileData* tileData = nullptr;
 private: 
 	bufferData bufferData; 
+	uint id_stream = 0, streamSize = 0; // the particles' vertices, rewritten each frame. Bytes
 	float4 color;
 	float size; 
 
@@ -20,6 +20,7 @@
 #include "ComponentMesh.h"
 #include "ComponentTransform.h"
 #include "ComponentMaterial.h"
+#include "FrustrumCuller.h"
 #include "ComponentParticleEmitter.h"
 #include "RNG.h"
 #include <filesystem>  
@@ -216,20 +217,97 @@ void panelData::mainMenuSpace::Execute(bool& ret)
 
 		if (ImGui::BeginMenu("Game Systems"))
 		{
-			if (ImGui::CollapsingHeader("Octree"))
+			if (ImGui::CollapsingHeader("Spatial Index"))
 			{
-				ImGui::TextColored(ImVec4(0, 1, 0, 1), "Note that one object can intersect with more than one node");
-				ImGui::Text(std::string("Octree Node Count: " + std::to_string(App->spatial_tree->GetNodeCount())).c_str());
+				static int backend = (int)App->spatial_tree->GetBackend(); 
+				ImGui::Combo("Backend", &backend, "Octree\0BVH\0"); 
+				if (ImGui::Button("Switch Backend"))
+					App->spatial_tree->SetBackend((SPATIAL_BACKEND)backend); 
+
+				ImGui::Text(std::string("Node Count: " + std::to_string(App->spatial_tree->GetNodeCount())).c_str());
 				ImGui::Text(std::string("Total Objects Inside Nodes: " + std::to_string(App->spatial_tree->GetInsideCount())).c_str());
-				ImGui::Text(std::string("Maximum Node Depth: " + std::to_string(App->spatial_tree->GetMaxNodeDepth())).c_str());
-				ImGui::Text(std::string("Maximum Possible objects in a node: " + std::to_string(App->spatial_tree->GetMaxNodeObjects())).c_str());
-				ImGui::Text(std::string("Nodes with maximum objects: " + std::to_string(App->spatial_tree->GetNodesWithMaxObjects())).c_str());
+
+				if (Octree* octree = App->spatial_tree->GetOctree())
+				{
+					ImGui::TextColored(ImVec4(0, 1, 0, 1), "Note that one object can intersect with more than one node");
+					ImGui::Text(std::string("Maximum Node Depth: " + std::to_string(octree->GetMaxNodeDepth())).c_str());
+					ImGui::Text(std::string("Maximum Possible objects in a node: " + std::to_string(octree->GetMaxNodeObjects())).c_str());
+					ImGui::Text(std::string("Nodes with maximum objects: " + std::to_string(octree->GetNodesWithMaxObjects())).c_str());
+					ImGui::Text(std::string("Objects stranded at the root (out of it): " + std::to_string(octree->GetStrandedCount())).c_str());
+
+					static float looseness = octree->GetLooseness(); 
+					ImGui::SliderFloat("Looseness", &looseness, 1.f, 3.f); 
+					if (ImGui::Button("Rebuild Octree"))
+						octree->SetLooseness(looseness, App->scene_intro->rootObj);
+					ImGui::Text((octree->IsLoose()) ? "Loose octree: static and non-static objects inside" : "Classic octree: static objects inside");
+
+					bool rebalancing = octree->IsRebalancing(); 
+					if (ImGui::Checkbox("Rebalance (merge underfull nodes, split hot ones)", &rebalancing))
+						octree->SetRebalancing(rebalancing); 
+					ImGui::Text("Merges: %u, re-splits: %u", octree->GetMergeCount(), octree->GetResplitCount());
+
+					// auto-tune: the parameters are saved with the scene
+					const OctreeTuner& tuner = App->spatial_tree->GetTuner(); 
+					switch (tuner.GetState())
+					{
+					case OCTREE_TUNE_STATE::RECORDING: ImGui::Text("Auto-tune: recording queries..."); break; 
+					case OCTREE_TUNE_STATE::RUNNING: ImGui::Text("Auto-tune: replaying them in the background..."); break; 
+					default: 
+						if (ImGui::Button("Auto-Tune Depth And Objects Per Node"))
+							App->spatial_tree->StartAutoTune(); 
+						break; 
+					}
+					if (tuner.GetState() == OCTREE_TUNE_STATE::DONE)
+					{
+						const OctreeTuneResult& best = tuner.GetBest(); 
+						ImGui::Text("Best: depth %u, %u per node, %.3f ms (current was %.3f ms)%s", best.maxDepth, best.maxNodeObjects, 
+							best.cost, tuner.GetResults()[0].cost, (tuner.BeatsCurrent()) ? ", adopted" : ", kept the current"); 
+					}
+				}
+				else if (BVH* bvh = App->spatial_tree->GetBVH())
+				{
+					ImGui::Text(std::string("Objects waiting for a rebuild: " + std::to_string(bvh->GetPendingCount())).c_str());
+					ImGui::Text((bvh->IsRebuilding()) ? "Rebuilding in the background..." : "Up to date");
+					if (ImGui::Button("Rebuild BVH"))
+						bvh->Rebuild(); 
+				}
+
+				// stats, to tune the parameters above
+				SpatialStats stats; 
+				App->spatial_tree->GetStats(stats); 
+				ImGui::Separator(); 
+				ImGui::Text("Leaves: %u, objects per leaf: %.2f average, %u max", stats.leafCount, stats.averageLeafObjects, stats.maxLeafObjects);
+				ImGui::Text("Objects: %u, references: %u (x%.2f)", stats.objectCount, stats.referenceCount, stats.duplicateFactor);
+				if (ImGui::TreeNode("Per Depth"))
+				{
+					for (uint depth = 0; depth < stats.nodesPerDepth.size(); ++depth)
+						ImGui::Text("Depth %u: %u nodes, %u objects", depth, stats.nodesPerDepth[depth], stats.objectsPerDepth[depth]);
+					ImGui::TreePop(); 
+				}
+				if (ImGui::TreeNode("Queries (average per query)"))
+				{
+					static const char* queryNames[] = { "Candidates", "Frustrum", "Raycast", "Nearest" };
+					for (int i = 0; i < (int)SPATIAL_QUERY::MAX; ++i)
+					{
+						const SpatialQueryStats& query = stats.queries[i]; 
+						double count = (query.queries) ? (double)query.queries : 1.0;
+						ImGui::Text("%s (%llu): %.1f nodes, %.1f aabb tests, %.1f object tests, %.1f candidates", queryNames[i], query.queries,
+							query.nodesVisited / count, query.aabbTests / count, query.objectTests / count, query.candidates / count);
+					}
+					if (ImGui::Button("Reset Counters"))
+						App->spatial_tree->ResetQueryStats(); 
+					ImGui::TreePop();
+				}
+				if (ImGui::Button("Export Stats (spatial_stats.json)"))
+					App->spatial_tree->ExportStats("spatial_stats.json"); 
 			}
 			if (ImGui::CollapsingHeader("Camera Culling"))
 			{
 				ImGui::Text("Number Of Objects Inside Current Camera View: ");
 				ImGui::Text(std::string("Objects In Octree Nodes Inside Frustrum: " + std::to_string(App->scene_intro->objectCandidatesBeforeFrustrumPrune)).c_str());
 				ImGui::Text(std::string("Objects Inside Frustrum: " + std::to_string(App->scene_intro->objectCandidatesAfterFrustrumPrune)).c_str());
+				if (ImGui::Button("Benchmark Culling (see console)"))
+					FrustrumCuller::Benchmark(*App->renderer3D->targetCamera->GetFrustrum()); 
 			}
 
 			ImGui::EndMenu();
@@ -386,6 +464,26 @@ void panelData::configSpace::Execute(bool& ret)
 
 				writer.EndArray();
 
+				// spatial index
+				writer.Key("SpatialTree");
+
+				writer.StartArray();
+
+				writer.StartObject();
+
+				writer.Key("Backend");
+				writer.String(SmileSpatialTree::GetBackendName(App->spatial_tree->GetBackend()));
+
+				if (Octree* octree = App->spatial_tree->GetOctree())
+				{
+					writer.Key("Looseness");
+					writer.Double(octree->GetLooseness());
+				}
+
+				writer.EndObject();
+
+				writer.EndArray();
+
 				writer.EndObject();
 
 				const char* output = buffer.GetString();
@@ -1017,6 +1115,14 @@ void panelData::InspectorSpace::ComponentData(Component* c)
 				if (ImGui::DragFloat("Emitter Bounding Radius", &bounding, 0.1f, 0.1f, 5.f))
 					emitter->GetParent()->ResizeBounding(bounding);
 
+				bool replaceOldest = emitter->data.emissionData.fullPool == fullPoolPolicy::REPLACE_OLDEST;
+				if (ImGui::Checkbox("Replace oldest when full", &replaceOldest))
+					emitter->data.emissionData.fullPool = (replaceOldest) ? fullPoolPolicy::REPLACE_OLDEST : fullPoolPolicy::SKIP;
+
+				ImGui::Checkbox("LOD (far: updated less often)", &emitter->data.emissionData.lod);
+				if (emitter->data.emissionData.lod)
+					ImGui::DragFloat("LOD Distance", &emitter->data.emissionData.lodDistance, 0.5f, 0.f, 500.f);
+
 				ImGui::Text(std::string("Current Blend Mode: " + blendMode).c_str());
 				emitter->data.blendmode = (ImGui::Checkbox("Alpha Blend", &alphaBlend)) ? blendMode::ALPHA_BLEND : blendMode::ADDITIVE;
 			
@@ -1252,7 +1358,7 @@ void panelData::InspectorSpace::ComponentData(Component* c)
 
 						static bool tiling = emitter->data.initialState.tex.second > 0.f;
 						ImGui::Checkbox("Tiling", &tiling);
-						auto tileData = emitter->mesh->tileData;
+						auto tileData = &emitter->data.tiles;
 						if (tiling)
 						{
 							ImGui::DragFloat("Animation Speed", &emitter->data.initialState.tex.second, 0.05f, 0.f, 1.f); // bug with 0 speed
@@ -1266,12 +1372,8 @@ void panelData::InspectorSpace::ComponentData(Component* c)
 						}
 						else
 						{
-							if (tileData != nullptr)
-							{
-								tileData->Reset();
-								emitter->mesh->own_mesh->ResetUvs(); 
-								emitter->data.initialState.tex.second = 0.f;
-							}
+							tileData->Reset();
+							emitter->data.initialState.tex.second = 0.f;
 
 						}
 
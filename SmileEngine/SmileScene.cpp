@@ -57,6 +57,7 @@ bool SmileScene::Start()
 bool SmileScene::CleanUp()
 {
 	rootObj->CleanUp();  
+	particleEffects.CleanUp(); 
  
 	selectedObj = nullptr; 
 	selected_mesh = nullptr; 
@@ -102,16 +103,24 @@ void CreateRocketo()
 // Update
 update_status SmileScene::Update(float dt)
 {
-	if(!pause)
+	// objects created or moved during the update reach the spatial tree together, before drawing
+	App->spatial_tree->BeginBatch();
+
+	if (!pause)
+	{
 		rootObj->Update(dt);
-	 
-	DrawObjects();
-	//HandleGizmo();
+		particleScheduler.Run();
+	}
 
 	// TODO: firework with input 
 	if (App->input->GetKey(SDL_SCANCODE_1) == KEY_DOWN && rocketoAction == false)
 		CreateRocketo(); 
 
+	App->spatial_tree->CommitBatch();
+	 
+	DrawObjects();
+	//HandleGizmo();
+
 
 	if (generalDbug == true)
 	{
@@ -136,18 +145,22 @@ static void GetNonStaticRecursive(std::vector<GameObject*>& drawObjects, GameObj
 
 void SmileScene::DrawObjects()
 {
-	// 1) collect static candidates to be drawn: search for octree nodes inside frustrum 
+	// 1) collect static objects inside the frustrum: the octree culls them itself
 	static std::vector<GameObject*> drawObjects;
-	App->spatial_tree->CollectCandidatesA(drawObjects, App->renderer3D->targetCamera->calcFrustrum);
+	static std::vector<GameObject*> nonStaticObjects;
+	App->spatial_tree->CollectFrustrumCandidates(drawObjects, *App->renderer3D->targetCamera->GetFrustrum());
 
-	// 2) add non-static ones 
-	GetNonStaticRecursive(drawObjects, rootObj); 
+	// 2) add non-static ones, unless the octree already keeps them (loose mode)
+	if (App->spatial_tree->IndexesDynamicObjects() == false)
+		GetNonStaticRecursive(nonStaticObjects, rootObj); 
 
 	// (debug)
-	objectCandidatesBeforeFrustrumPrune = drawObjects.size();
+	objectCandidatesBeforeFrustrumPrune = drawObjects.size() + nonStaticObjects.size();
 
-	// 3) then test all of their OBBs with the frustrum
-	App->renderer3D->targetCamera->PruneInsideFrustrum(drawObjects);
+	// 3) then test the non-static ones' OBBs with the frustrum
+	App->renderer3D->targetCamera->PruneInsideFrustrum(nonStaticObjects);
+	drawObjects.insert(drawObjects.end(), nonStaticObjects.begin(), nonStaticObjects.end()); 
+	nonStaticObjects.clear(); 
 
 	// (debug)
 	objectCandidatesAfterFrustrumPrune = drawObjects.size();
@@ -161,11 +174,6 @@ void SmileScene::DrawObjects()
 	drawObjects.clear(); 
 }
 
-update_status SmileScene::PostUpdate(float dt)
-{
-	rootObj->PostUpdate(); 
-	return UPDATE_CONTINUE;
-}
 void SmileScene::HandleGizmo()
 {
 	if (selectedObj == nullptr)
@@ -359,22 +367,22 @@ std::variant<ComponentMesh*, GameObject*> SmileScene::HoverRayReturn(bool GetMes
 ComponentMesh* SmileScene::FindRayIntersection(math::LineSegment ray)
 {
 	lastRay = ray;
-	ComponentMesh* closest = nullptr; 
-	float minDistance = (float)INT_MAX; 
-	
-	// See the function definition in the spatial tree header
-	std::vector<GameObject*> objects; 
-	App->spatial_tree->CollectCandidates(objects, ray); 
 
-	for (auto& gameObject : objects)
+	// The spatial tree visits the objects front to back: the triangles of the ones behind the closest hit are never tested 
+	SpatialHit hit = App->spatial_tree->Raycast(ray, [&ray](GameObject* gameObject, float& distance)
 	{
 		// Get the mesh  
 		ComponentMesh* mesh = dynamic_cast<ComponentMesh*>(gameObject->GetComponent(MESH));
+		if (mesh == nullptr) // the octree also keeps emitters, cameras... 
+			return false; 
 		auto mesh_inf = mesh->GetResourceMesh()->GetMeshData(); 
 		if (mesh_inf.index() == 1 || std::get<ModelMeshData*>(mesh_inf) == nullptr) // TODO: this skips own meshes (Plane etc) so either consider them or do not have them clickable (particle planes)
-			continue;
+			return false;
 
 		auto mesh_info = std::get<ModelMeshData*>(mesh_inf);
+		math::float4x4 targetMat = gameObject->GetTransform()->GetGlobalMatrix(); 
+		bool found = false; 
+
 		// Find intersection then with mesh triangles
 		for (int i = 0; i < mesh_info->num_vertex; i += 9) // 3 vertices * 3 coords (x,y,z) 
 		{
@@ -384,27 +392,21 @@ ComponentMesh* SmileScene::FindRayIntersection(math::LineSegment ray)
 
 			// form a triangle and translate to global coords to test with ray!
 			math::Triangle tri = math::Triangle(v1, v2, v3);
-			math::float4x4 targetMat = gameObject->GetTransform()->GetGlobalMatrix(); 
 			tri.Transform(targetMat); 
 
-			// Finally check if the ray interesects with the face (triangle) 
-			float newDistance = 0, intersectionPoint = 0; 
-			if (lastRay.Intersects(tri, &newDistance, (math::float3*)nullptr))
+			// Finally check if the ray interesects with the face (triangle), keep the closest one
+			float newDistance = 0; 
+			if (ray.Intersects(tri, &newDistance, (math::float3*)nullptr) && (found == false || newDistance < distance))
 			{
-				// TODO: push check the closest, keep searching 
-				// return dynamic_cast<ComponentMesh*>(mesh);
-				if (newDistance < minDistance)
-				{
-					minDistance = newDistance; 
-					closest = mesh;
-				}
-			
+				distance = newDistance; 
+				found = true; 
 			}
-
 		}
-	}
 
-	return closest;
+		return found; 
+	});
+
+	return (hit.object) ? dynamic_cast<ComponentMesh*>(hit.object->GetComponent(MESH)) : nullptr;
 }
 
 
@@ -430,66 +432,12 @@ math::LineSegment SmileScene::TraceRay(float2 normMousePos)
 
 void CreateSmoke(float3 pos)
 {
-	GameObject* emitter = App->object_manager->CreateGameObject("Emitter", App->scene_intro->rootObj);
-	AllData data;
-	data.initialState.life = std::pair(0.5f, 0.2f);
-	data.emissionData.time = 0.03f;
-	data.emissionData.maxParticles = 1000; 
-	data.emissionData.randomSpeed = std::pair(true, std::pair(float3(-0.5f, 2.f, -0.5f), float3(0.5f, 2.f, 0.5f)));
-	data.emissionData.texPath = LIBRARY_TEXTURES_FOLDER_A + std::string("smokesheet.dds");
-	data.initialState.tex = std::pair(true, 0.1f);
-	data.emissionData.burstTime = 1.f; 
-	data.emissionData.gravity = false; 
-	data.initialState.color.first = float4(0.2f, 0.2f, 0.2f, 0.5f); 
-	data.initialState.color.second = float4(0.8f, 0.8f, 0.8f, 0.5f);
-
-	auto emmiterComp = DBG_NEW ComponentParticleEmitter(emitter, data);
-	emitter->AddComponent((Component*)emmiterComp);
-	
-	emmiterComp->mesh->tileData->nCols = emmiterComp->mesh->tileData->nRows = 7;
-	emmiterComp->mesh->tileData->maxTiles = 46;
-
-	emitter->Start(); 
-	auto mat = emitter->GetTransform()->GetGlobalMatrix(); 
-	mat.SetTranslatePart(pos); 
-	emitter->GetTransform()->SetGlobalMatrix(mat); 
-	App->spatial_tree->OnStaticChange(emitter, true); 
+	App->scene_intro->particleEffects.Spawn(particleEffect::SMOKE, float4x4::FromTRS(pos, float4x4::identity, float3::one));
 }
 
 void CreateFireWork()
 {
 	App->scene_intro->rocketoAction = false;
-	GameObject* emitter = App->object_manager->CreateGameObject("Emitter", App->scene_intro->rootObj);
-	AllData data;
-
-	data.initialState.life.first = 0.4f;
-	data.initialState.life.second = std::get<float>(RNG::GetRandomValue(0.6f, 1.f));
-
-	float variantSize = std::get<float>(RNG::GetRandomValue(0.f, 1.5f));
-	data.initialState.size.first = 0.5f;
-	data.initialState.size.second = 0.5f + variantSize;
-
-	data.emissionData.randomSpeed.first = true;
-	float variantSp = std::get<float>(RNG::GetRandomValue(-5.f, 5.f)); 
-	data.emissionData.randomSpeed.second.first = float3(23 + variantSp, 23 + variantSp, 5 + variantSp);
-
-	data.emissionData.gravity = true;
-	data.emissionData.time = 0.001;
-
-	for (int i = 0; i < 3; ++i)
-		data.initialState.color.first[i] = std::get<float>(RNG::GetRandomValue(0.f, 1.f)); 
-	data.initialState.color.first[3] = 1.f; 
-	for (int i = 0; i < 3; ++i)
-		data.initialState.color.second[i] = std::get<float>(RNG::GetRandomValue(0.f, 1.f));
-	data.initialState.color.second[3] = 0.f;
-
-	auto emmiterComp = DBG_NEW ComponentParticleEmitter(emitter, data);
-	emitter->AddComponent((Component*)emmiterComp);
-	emitter->GetTransform()->SetGlobalMatrix(App->scene_intro->rootObj->Find("rocketo")->GetTransform()->GetGlobalMatrix());
-
-	// VERY IMPORTANT, CALL START, IT WILL SETUP THE BOUNDING BOX
-	emitter->Start();
-	emmiterComp->data.emissionData.expireTime = std::get<float>(RNG::GetRandomValue(0.5f, 1.5f));
-	emmiterComp->destroyOnFinish = true; 
-	App->spatial_tree->OnStaticChange(emitter, true);
+	GameObject* emitter = App->scene_intro->particleEffects.Spawn(particleEffect::FIREWORK, App->scene_intro->rootObj->Find("rocketo")->GetTransform()->GetGlobalMatrix());
+	emitter->GetEmitter()->data.emissionData.expireTime = std::get<float>(RNG::GetRandomValue(0.5f, 1.5f));
 }
\ No newline at end of file
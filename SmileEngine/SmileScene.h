@@ -5,6 +5,8 @@
 #include "GameObject.h"
 #include "ComponentMesh.h"
 #include "ComponentCamera.h"
+#include "ParticleScheduler.h"
+#include "ParticleEffectPool.h"
 #include <vector>
 #include <variant>
 
@@ -25,7 +27,6 @@ public:
 
 	bool Start();
 	update_status Update(float dt);
-	update_status PostUpdate(float dt);
 	bool CleanUp();
 	bool Reset(); 
 
@@ -51,6 +52,8 @@ private:
 public:
 	bool pause = false; 
 	GameObject* rootObj = nullptr;
+	ParticleScheduler particleScheduler; // the emitters, after the objects
+	ParticleEffectPool particleEffects; // the fireworks and such, recycled
 	GameObject* selectedObj = nullptr; 
 	ComponentMesh* selected_mesh = nullptr;
 	ComponentCamera* debugCamera = nullptr; 
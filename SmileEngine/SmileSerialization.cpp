@@ -223,6 +223,9 @@ bool SmileSerialization::SaveSceneNode(GameObject* obj, rapidjson::Writer<rapidj
 
 	writer.EndObject();
 
+	if (parent == nullptr) // the root: the scene's own settings go next to it
+		App->spatial_tree->SaveSceneSettings(writer);
+
 	writer.EndObject(); // end gameObject object
 
 	return false;
@@ -338,7 +341,9 @@ GameObject* SmileSerialization::LoadSceneNode(GameObject* parent, rapidjson::Val
 				// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -  Emitter
 			    bool active = object["Active"].GetBool(); 
 				uint maxParticles = object["Max Particles"].GetInt(); 
-				uint lastUsedParticle = object["Last Used Particle"].GetInt(); 
+				fullPoolPolicy fullPool = (object.HasMember("Full Pool") && std::string(object["Full Pool"].GetString()) == "REPLACE OLDEST") ? fullPoolPolicy::REPLACE_OLDEST : fullPoolPolicy::SKIP;
+				bool lod = (object.HasMember("LOD")) ? object["LOD"].GetBool() : true; 
+				float lodDistance = (object.HasMember("LOD Distance")) ? object["LOD Distance"].GetFloat() : 30.f; 
 				float boundingBoxRadius = object["Bounding Box Radius"].GetFloat(); 
 				std::string blendModeString = object["Blend Mode"].GetString(); 
 				blendMode blendMode = (blendModeString == "ALPHA BLEND") ? blendMode::ALPHA_BLEND : blendMode::ADDITIVE; 
@@ -431,6 +436,9 @@ GameObject* SmileSerialization::LoadSceneNode(GameObject* parent, rapidjson::Val
 				data.emissionData.gravity = gravity;
 				data.emissionData.maxParticles = maxParticles;
 				data.emissionData.randomColor = hasRandomColor;
+				data.emissionData.fullPool = fullPool;
+				data.emissionData.lod = lod;
+				data.emissionData.lodDistance = lodDistance;
 
 				data.emissionData.randomSpeed.first = hasRandomSpeed;
 				if (hasRandomSpeed) {
@@ -460,12 +468,11 @@ GameObject* SmileSerialization::LoadSceneNode(GameObject* parent, rapidjson::Val
 				data.initialState.tex.second = animSpeed;
 				data.initialState.transparency = transp;
 				ComponentParticleEmitter* emitter = DBG_NEW ComponentParticleEmitter(obj, data);
-				emitter->lastUsedParticle = lastUsedParticle;
 				obj->ResizeBounding(boundingBoxRadius);
 				emitter->active = active;
-				emitter->mesh->tileData->maxTiles = maxTiles;
-				emitter->mesh->tileData->nCols = nCols;
-				emitter->mesh->tileData->nRows = nRows;
+				emitter->data.tiles.maxTiles = maxTiles;
+				emitter->data.tiles.nCols = nCols;
+				emitter->data.tiles.nRows = nRows;
 
 				// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -  Particles
 				auto particles = object["Particles"].GetArray();
@@ -511,37 +518,34 @@ GameObject* SmileSerialization::LoadSceneNode(GameObject* parent, rapidjson::Val
 
 					auto camDistance = particle["Cam Distance"].GetFloat();
 					auto size = particle["Size"].GetFloat();
-					auto transparency = particle["Transparency"].GetFloat();
 					auto tileIndex = particle["Tile Index"].GetInt();
 					auto lastTileFrame = particle["Last Tile Frame"].GetFloat();
-					auto needTileUpdate = particle["Need Tile Update"].GetBool();
-
-
-
-					emitter->particles.at(i).currentState.active = active;
-					emitter->particles.at(i).currentState.color = Color;
-					emitter->particles.at(i).currentState.currentLifeTime = currentLifeTime;
-					emitter->particles.at(i).currentState.lastTileframe = lastTileFrame;
-					emitter->particles.at(i).currentState.life = life;
-					emitter->particles.at(i).currentState.needTileUpdate = needTileUpdate;
-					emitter->particles.at(i).currentState.size = size;
-					emitter->particles.at(i).currentState.speed = Speed;
-					emitter->particles.at(i).currentState.tileIndex = tileIndex;
-					emitter->particles.at(i).currentState.transparency = transparency;
-					emitter->particles.at(i).camDist = camDistance; 
-					emitter->particles.at(i).transf.parentMatrix = obj->GetParent()->GetTransform()->GetGlobalMatrix();
-					float localMat[16], globalMat[16]; 
-					auto localMatArray = particle["Local Matrix"].GetArray();
-					auto globalMatArray = particle["Global Matrix"].GetArray();
-					for (rapidjson::SizeType i = 0; i < localMatArray.Size(); i++)
-						localMat[i] = localMatArray[i].GetDouble();
-					for (rapidjson::SizeType i = 0; i < globalMatArray.Size(); i++)
-						globalMat[i] = globalMatArray[i].GetDouble();
-
-					// TODO: update transform 
+
+
+
+					// Particles live in world space: the position is the global matrix' translation
+					auto& p = emitter->simulation.particles;
+					if (counter < p.Size())
+					{
+						float globalMat[16];
+						auto globalMatArray = particle["Global Matrix"].GetArray();
+						for (rapidjson::SizeType i = 0; i < globalMatArray.Size(); i++)
+							globalMat[i] = globalMatArray[i].GetDouble();
+
+						p.life[counter] = (active) ? life : 0.f;
+						p.lifeTime[counter] = currentLifeTime;
+						p.SetColor(counter, (RandomColor.IsFinite()) ? RandomColor : Color);
+						p.SetSpeed(counter, (RandomSpeed.xyz().IsFinite()) ? RandomSpeed.xyz() : Speed);
+						p.size[counter] = size;
+						p.tile[counter] = tileIndex;
+						p.tileTime[counter] = lastTileFrame;
+						p.camDist[counter] = camDistance;
+						p.SetPosition(counter, float3(globalMat[3], globalMat[7], globalMat[11]));
+					}
 
 					counter++;
 				}
+				emitter->simulation.particles.RebuildFreeSlots();
 				// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -  Particles
 
 
@@ -580,7 +584,7 @@ void SmileSerialization::LoadScene(const char* path, bool startup)
 	
 	if (startup == false)
 	{
-		// 1) Clear Octree
+		// 1) Clear the spatial index
 		App->spatial_tree->CleanUp();
 		// 2) Clear All Objects
 		App->scene_intro->Reset();
@@ -591,6 +595,8 @@ void SmileSerialization::LoadScene(const char* path, bool startup)
 	// 4) Then Load
 	rapidjson::Value& value = doc["GameObject"]; 
 	LoadSceneNode(nullptr, value, doc)->Start();  // starts root 
-	// 5) Afterwards, create Octree again
-	App->spatial_tree->CreateOctree(math::AABB(float3(-100, -100, -100), float3(100, 100, 100)));
+	// 5) Afterwards, create the spatial index again, with the scene's parameters
+	if (doc.HasMember("SpatialTree"))
+		App->spatial_tree->LoadSceneSettings(doc["SpatialTree"]);
+	App->spatial_tree->CreateIndex();
 }
@@ -4,12 +4,17 @@
 #pragma warning( disable : 4577 ) // Warning that exceptions are disabled
 #pragma warning( disable : 4530 )
 
+// Windows only. Elsewhere (e.g. the headless benchmarks), no leak reports
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <stdio.h>
 
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
+#ifdef _WIN32
 #include <crtdbg.h>
+#endif
 
 #ifdef _DEBUG
 #define DBG_NEW new ( _NORMAL_BLOCK , __FILE__ , __LINE__ )
@@ -19,9 +24,13 @@
 #define DBG_NEW new
 #endif
 
+#ifdef _WIN32
 #define ReportMemoryLeaks() _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF)
-
 #define LOG(format, ...) _log(__FILE__, __LINE__, format, __VA_ARGS__);
+#else
+#define ReportMemoryLeaks()
+#define LOG(format, ...) _log(__FILE__, __LINE__, format, ##__VA_ARGS__);
+#endif
 
 void _log(const char file[], int line, const char* format, ...);
 
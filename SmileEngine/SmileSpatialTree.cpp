@@ -2,216 +2,392 @@
 #include "Glew/include/GL/glew.h" 
 #include "SmileApp.h"
 #include "SmileScene.h"
+#include "SmileUtilitiesModule.h"
+#include "JSONParser.h"
 #include "imgui/imgui.h"
+#include <fstream>
  
 
 SmileSpatialTree::SmileSpatialTree(SmileApp* app, bool start_enabled) : SmileModule(app, start_enabled){}
 SmileSpatialTree::~SmileSpatialTree() 
 {
-	RELEASE(root);
+	RELEASE(index); 
 }
 
-void SmileSpatialTree::CreateOctree(math::AABB aabb, uint depth, uint maxNodeObjects)
+bool SmileSpatialTree::Init()
 {
-	MAX_NODE_OBJECTS = maxNodeObjects; 
-	MAX_DEPTH = depth; 
+	// the backend, from config. Missing means octree
+	rapidjson::Document doc;
+	dynamic_cast<JSONParser*>(App->utilities->GetUtility("JSONParser"))->ParseJSONFile("config.json", doc);
+	if (doc.IsObject())
+	{
+		if (auto value = rapidjson::GetValueByPointer(doc, "/SpatialTree/0/Backend"); value && value->IsString())
+			backend = (std::string(value->GetString()) == GetBackendName(SPATIAL_BACKEND::BVH)) ? SPATIAL_BACKEND::BVH : SPATIAL_BACKEND::OCTREE;
+		if (auto value = rapidjson::GetValueByPointer(doc, "/SpatialTree/0/Looseness"); value && value->IsNumber())
+			octreeLooseness = value->GetFloat(); 
+	}
 
-	if(root)
-		ComputeObjectTree(App->scene_intro->rootObj);
-	else
-		CreateRoot(aabb);
+	LOG("Spatial index backend: %s", GetBackendName(backend)); 
+	index = CreateBackend(backend); 
+	return true; 
 }
 
-void SmileSpatialTree::CreateRoot(math::AABB aabb)
+void SmileSpatialTree::CreateIndex()
 {
-	// the root is to be created once
-	root = DBG_NEW OctreeNode(aabb);
-	ComputeObjectTree(App->scene_intro->rootObj);
+	ClearBatch(); // the whole scene goes in anyway
+	index->Insert(App->scene_intro->rootObj); 
+}
+
+void SmileSpatialTree::SetBackend(SPATIAL_BACKEND backend)
+{
+	if (index)
+	{
+		if (auto octree = GetOctree())
+			octreeLooseness = octree->GetLooseness(); 
+		index->Clear(); 
+		RELEASE(index); 
+	}
 
-	nodeCount++; 
+	this->backend = backend; 
+	index = CreateBackend(backend);
+	if (App->scene_intro->rootObj)
+		index->Insert(App->scene_intro->rootObj);
 }
 
-void SmileSpatialTree::ComputeObjectTree(GameObject* obj)
+SpatialIndex* SmileSpatialTree::CreateBackend(SPATIAL_BACKEND backend) const
 {
-	if(obj->GetStatic() == true) // wohoa! 
-		root->InsertObject(obj);
-	
-	auto children = obj->GetImmidiateChildren();
-	for (auto& obj : children)
-		ComputeObjectTree(obj);
+	switch (backend)
+	{
+	case SPATIAL_BACKEND::BVH:
+		return DBG_NEW BVH(); 
+	default:
+		return DBG_NEW Octree(math::AABB(float3(-100, -100, -100), float3(100, 100, 100)), octreeMaxDepth, octreeMaxNodeObjects, octreeLooseness); 
+	}
+}
+
+void SmileSpatialTree::SetOctreeParameters(uint maxDepth, uint maxNodeObjects)
+{
+	octreeMaxDepth = maxDepth; 
+	octreeMaxNodeObjects = maxNodeObjects; 
+	if (Octree* octree = GetOctree())
+		octree->SetParameters(maxDepth, maxNodeObjects, App->scene_intro->rootObj); 
 }
 
 update_status SmileSpatialTree::Update(float dt)
 {
-	if (root && App->scene_intro->generalDbug)
-		root->Debug(); 
+	// auto-tune: the results are in
+	if (Octree* octree = GetOctree())
+	{
+		if (octreeTuner.Update(*octree) && octreeTuner.BeatsCurrent())
+		{
+			const OctreeTuneResult& best = octreeTuner.GetBest(); 
+			LOG("Octree auto-tune: max depth %u, %u objects per node (%.3f ms, was %.3f ms)", best.maxDepth, best.maxNodeObjects, 
+				best.cost, octreeTuner.GetResults()[0].cost); 
+			SetOctreeParameters(best.maxDepth, best.maxNodeObjects); 
+		}
+	}
+	else if (octreeTuner.GetState() == OCTREE_TUNE_STATE::RECORDING || octreeTuner.GetState() == OCTREE_TUNE_STATE::RUNNING)
+		octreeTuner.Cancel(); 
+
+	index->Update(dt); 
+	if (App->scene_intro->generalDbug)
+		index->Debug(); 
 	return update_status::UPDATE_CONTINUE;
 }
 
 bool SmileSpatialTree::CleanUp()
 {
-	root->CleanUp(); 
-	
-
+	octreeTuner.Cancel(); // what it recorded is of this scene
+	ClearBatch(); 
+	if (index)
+		index->Clear(); 
 	return true; 
 }
 
 void SmileSpatialTree::OnStaticChange(GameObject* obj, bool isStatic)
 {
-	if (isStatic)
-		ComputeObjectTree(obj); 
+	if (isStatic || index->IndexesDynamicObjects())
+	{
+		if (IsBatching())
+			QueueChange(obj, SPATIAL_BATCH_INSERT);
+		else
+			index->Insert(obj); 
+	}
 	else
-		root->DeleteObject(obj); 
+		RemoveObject(obj); 
 }
 
+void SmileSpatialTree::RemoveObject(GameObject* obj)
+{
+	DropQueuedChanges(obj); 
+	if (index)
+		index->Remove(obj); 
+}
+
+void SmileSpatialTree::OnObjectMoved(GameObject* obj)
+{
+	if (IsBatching())
+		QueueChange(obj, SPATIAL_BATCH_MOVE);
+	else if (index)
+		index->OnObjectMoved(obj); 
+}
 
-// ----------------------------------------------------------------- [OctreeNode]
-OctreeNode::OctreeNode(OctreeNode* parentNode, uint i)
+// ----------------------------------------------------------------- [Scene settings]
+void SmileSpatialTree::SaveSceneSettings(rapidjson::Writer<rapidjson::StringBuffer>& writer) const
 {
-	this->parentNode = parentNode; 
-	this->depth = parentNode->depth + 1; 
+	writer.Key("SpatialTree");
+	writer.StartObject();
+	writer.Key("MaxDepth");
+	writer.Uint(octreeMaxDepth);
+	writer.Key("MaxNodeObjects");
+	writer.Uint(octreeMaxNodeObjects);
+	writer.EndObject();
+}
 
-	// front Z face -> 0,1,2,3 and back Z face -> 4,5,6,7 counter clock-wise, starting from bottom left 
-	float3 min, max; 
-	min = max = float3(0, 0, 0);
+// Scenes saved before auto-tune have none: they keep the current ones
+void SmileSpatialTree::LoadSceneSettings(const rapidjson::Value& value)
+{
+	uint maxDepth = octreeMaxDepth, maxNodeObjects = octreeMaxNodeObjects; 
+	if (value.HasMember("MaxDepth") && value["MaxDepth"].IsUint())
+		maxDepth = value["MaxDepth"].GetUint(); 
+	if (value.HasMember("MaxNodeObjects") && value["MaxNodeObjects"].IsUint())
+		maxNodeObjects = value["MaxNodeObjects"].GetUint(); 
+	SetOctreeParameters(maxDepth, maxNodeObjects); 
+}
 
-	min.x = ((i == 0) || (i == 3) || (i == 4) || (i == 7)) ? parentNode->AABB.MinX() : (parentNode->AABB.MaxX() - parentNode->AABB.HalfSize().x); 
-	max.x = ((i == 0) || (i == 3) || (i == 4) || (i == 7)) ? (parentNode->AABB.MinX() + parentNode->AABB.HalfSize().x) : parentNode->AABB.MaxX();
+// ----------------------------------------------------------------- [Batch]
+// Inserts first, all in one go (the index sorts them), then moves. An object moved and inserted in the same batch is
+// just inserted, with its last bounds
+void SmileSpatialTree::CommitBatch()
+{
+	if (batchDepth == 0 || --batchDepth > 0)
+		return; 
 
-	min.y = ((i == 0) || (i == 1) || (i == 4) || (i == 5)) ? parentNode->AABB.MinY() : (parentNode->AABB.MaxY() - parentNode->AABB.HalfSize().y);
-	max.y = ((i == 0) || (i == 1) || (i == 4) || (i == 5)) ? (parentNode->AABB.MinY() + parentNode->AABB.HalfSize().y) : parentNode->AABB.MaxY();
+	if (index)
+	{
+		std::vector<GameObject*> inserts; 
+		for (uint i = 0; i < batchObjects.size(); ++i)
+			if (batchChanges[i] & SPATIAL_BATCH_INSERT)
+				inserts.push_back(batchObjects[i]); 
+		index->InsertBatch(inserts); 
+
+		for (uint i = 0; i < batchObjects.size(); ++i)
+			if (batchChanges[i] == SPATIAL_BATCH_MOVE)
+				index->OnObjectMoved(batchObjects[i]); 
+	}
 
-	min.z = (i > 3) ? parentNode->AABB.MinZ() : (parentNode->AABB.MaxZ() - parentNode->AABB.HalfSize().z);
-	max.z = (i > 3) ? (parentNode->AABB.MinZ() + parentNode->AABB.HalfSize().z) : parentNode->AABB.MaxZ();
-	
-	this->AABB = math::AABB(min, max); 
+	ClearBatch(); 
 }
 
-OctreeNode::~OctreeNode() { App->spatial_tree->nodeCount--; };
-
-void OctreeNode::InsertObject(GameObject* obj)
+void SmileSpatialTree::QueueChange(GameObject* obj, uint change)
 {
-	// A) I have child nodes, then pass the object directly to them (conditions) 
-	if (IsLeaf() == false)
+	auto slot = batchSlots.find(obj); 
+	if (slot != batchSlots.end())
 	{
-		if (SendObjectToChildren(obj) == false) 
-			insideObjs.push_back(obj); 
+		batchChanges[slot->second] |= change; 
+		return; 
 	}
-	else // B) I do not have child nodes right now
-	{
-		// if I have the maximum objects, but splitting means exceeding the max tree depth, rather keep the object for myself
-		if (depth == MAX_DEPTH)
-		{
-			insideObjs.push_back(obj);
-			return;
-		}
 
-		// If I have less than the maximum objects, push it directly
-		if (insideObjs.size() < MAX_NODE_OBJECTS)
-			insideObjs.push_back(obj);
+	batchSlots[obj] = batchObjects.size(); 
+	batchObjects.push_back(obj); 
+	batchChanges.push_back(change); 
+}
 
-		else // If I have the maximum objects, split and rearrange objects
-		{
-			Split();
-			insideObjs.push_back(obj);
-			RearrangeObjectsInChildren();
+void SmileSpatialTree::DropQueuedChanges(GameObject* obj)
+{
+	auto slot = batchSlots.find(obj);
+	if (slot == batchSlots.end())
+		return; 
 
-		}
+	// swap with the last one and pop
+	uint i = slot->second; 
+	batchSlots.erase(slot); 
+	if (i != batchObjects.size() - 1)
+	{
+		batchObjects[i] = batchObjects.back(); 
+		batchChanges[i] = batchChanges.back(); 
+		batchSlots[batchObjects[i]] = i; 
 	}
-
+	batchObjects.pop_back(); 
+	batchChanges.pop_back(); 
 }
 
-void OctreeNode::Split()
+void SmileSpatialTree::ClearBatch()
 {
-	for (int i = 0; i < 8; ++i)
-		childNodes[i] = DBG_NEW OctreeNode(this, i);
+	batchObjects.clear(); 
+	batchChanges.clear(); 
+	batchSlots.clear(); 
+}
 
-	App->spatial_tree->nodeCount += 8; 
+// ----------------------------------------------------------------- [Stats]
+void SmileSpatialTree::GetStats(SpatialStats& stats) const
+{
+	if (index)
+		index->GetStats(stats);
 }
- 
-// Push the object to children that can encompass it  
-bool OctreeNode::SendObjectToChildren(GameObject* obj) 
+
+void SmileSpatialTree::ResetQueryStats()
 {
-	uint success = 0; 
+	if (index)
+		index->ResetQueryStats();
+}
 
-	for (int i = 0; i < 8; ++i)
-	{
-		OctreeNode* childNode = childNodes[i]; 
-		if (childNode->AABB.Intersects(obj->GetBoundingData().AABB))
-		{
-			success++; 
-			childNode->InsertObject(obj); 
-		}
-	
-	}
-	
-	// If the object has been pushed to any of the child nodes, return true
-	if (success > 0)
-		return true; 
+bool SmileSpatialTree::ExportStats(const char* path) const
+{
+	SpatialStats stats;
+	GetStats(stats);
 
-	return false; 
-}
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 
+	writer.StartObject();
 
-// Takes all the objects and erases the ones that intersect with a child, while pushing it to the child's list
-void OctreeNode::RearrangeObjectsInChildren()
-{
-	for(std::vector<GameObject*>::iterator obj = insideObjs.begin(); obj != insideObjs.end();)
+	// the parameters the numbers come from
+	writer.Key("Backend");
+	writer.String(GetBackendName(backend));
+	if (Octree* octree = GetOctree())
 	{
-		GameObject* capture = (*obj); 
-
-		std::array<bool, 8> intersections; 
-		std::fill(std::begin(intersections), std::end(intersections), false);
+		writer.Key("Looseness");
+		writer.Double(octree->GetLooseness());
+		writer.Key("MaxDepth");
+		writer.Uint(octree->GetMaxNodeDepth());
+		writer.Key("MaxNodeObjects");
+		writer.Uint(octree->GetMaxNodeObjects());
+	}
 
-		for (int i = 0; i < 8; ++i)
-			if (childNodes[i]->AABB.Intersects((*obj)->GetBoundingData().AABB))
-				intersections.at(i) = true; 
+	writer.Key("Nodes");
+	writer.Uint(stats.nodeCount);
+	writer.Key("Leaves");
+	writer.Uint(stats.leafCount);
+	writer.Key("Objects");
+	writer.Uint(stats.objectCount);
+	writer.Key("References");
+	writer.Uint(stats.referenceCount);
+	writer.Key("DuplicateFactor");
+	writer.Double(stats.duplicateFactor);
+	writer.Key("AverageLeafObjects");
+	writer.Double(stats.averageLeafObjects);
+	writer.Key("MaxLeafObjects");
+	writer.Uint(stats.maxLeafObjects);
+
+	writer.Key("Depths");
+	writer.StartArray();
+	for (uint depth = 0; depth < stats.nodesPerDepth.size(); ++depth)
+	{
+		writer.StartObject();
+		writer.Key("Nodes");
+		writer.Uint(stats.nodesPerDepth[depth]);
+		writer.Key("Objects");
+		writer.Uint(stats.objectsPerDepth[depth]);
+		writer.EndObject();
+	}
+	writer.EndArray();
 
-		// if the object intersects with all 8 child nodes, it'd be a waste to push it to all 8 nodes 
-		if (std::all_of(std::begin(intersections), std::end(intersections), [](bool value) { return value; }))
-		{
-			++obj; 
-		}
-			
-		else // otherwise erase it from the Node, and push it to all the intersecting children
-		{
-			obj = insideObjs.erase(obj);
+	static const char* queryNames[] = { "Candidates", "Frustrum", "Raycast", "Nearest" };
+	writer.Key("Queries");
+	writer.StartObject();
+	for (int i = 0; i < (int)SPATIAL_QUERY::MAX; ++i)
+	{
+		const SpatialQueryStats& query = stats.queries[i];
+		writer.Key(queryNames[i]);
+		writer.StartObject();
+		writer.Key("Queries");
+		writer.Uint64(query.queries);
+		writer.Key("NodesVisited");
+		writer.Uint64(query.nodesVisited);
+		writer.Key("AABBTests");
+		writer.Uint64(query.aabbTests);
+		writer.Key("ObjectTests");
+		writer.Uint64(query.objectTests);
+		writer.Key("Candidates");
+		writer.Uint64(query.candidates);
+		writer.EndObject();
+	}
+	writer.EndObject();
 
-			for (int i = 0; i < 8; ++i)
-				if (intersections.at(i) == true)
-					childNodes[i]->InsertObject(capture);
-		}
-		
+	writer.EndObject();
 
+	std::ofstream file(path);
+	if (file.is_open() == false)
+	{
+		LOG("Could not export the spatial index stats to %s", path);
+		return false;
 	}
+	file << buffer.GetString();
+	LOG("Spatial index stats exported to %s", path);
+	return true;
 }
 
-void OctreeNode::DeleteObject(GameObject* newObj)
+void SpatialStats::AddNode(uint depth, uint objects, bool leaf)
 {
-	// Erase from the list if found. It won't be on any child's list, so return. 
-	for (std::vector<GameObject*>::iterator obj = insideObjs.begin(); obj != insideObjs.end(); ++obj)
+	if (depth >= nodesPerDepth.size())
 	{
-		if ((*obj) == newObj) 
-		{
-			obj = insideObjs.erase(obj);
-			return; 
-		}
+		nodesPerDepth.resize(depth + 1, 0);
+		objectsPerDepth.resize(depth + 1, 0);
+	}
+	nodesPerDepth[depth]++;
+	objectsPerDepth[depth] += objects;
 
+	nodeCount++;
+	referenceCount += objects;
+	if (leaf)
+	{
+		leafCount++;
+		averageLeafObjects += objects; // the sum, until Finish()
+		maxLeafObjects = (objects > maxLeafObjects) ? objects : maxLeafObjects;
 	}
+}
+
+void SpatialStats::Finish(uint objects)
+{
+	objectCount = objects;
+	duplicateFactor = (objects) ? (float)referenceCount / (float)objects : 0.f;
+	averageLeafObjects = (leafCount) ? averageLeafObjects / (float)leafCount : 0.f;
+}
 
-	// Otherwise, recurse
-	if (IsLeaf() == true)
-		return;
-	for (auto& childNode : childNodes)
-		childNode->DeleteObject(newObj); 
+void SpatialIndex::GetStats(SpatialStats& stats) const
+{
+	GetTreeStats(stats);
+	for (int i = 0; i < (int)SPATIAL_QUERY::MAX; ++i)
+		stats.queries[i] = GetQueryStats((SPATIAL_QUERY)i);
 }
- 
-void OctreeNode::Debug()
+
+SpatialQueryStats SpatialIndex::GetQueryStats(SPATIAL_QUERY type) const
+{
+	auto& totals = queryTotals[(int)type];
+	SpatialQueryStats ret;
+	ret.queries = totals[0].load(std::memory_order_relaxed);
+	ret.nodesVisited = totals[1].load(std::memory_order_relaxed);
+	ret.aabbTests = totals[2].load(std::memory_order_relaxed);
+	ret.objectTests = totals[3].load(std::memory_order_relaxed);
+	ret.candidates = totals[4].load(std::memory_order_relaxed);
+	return ret;
+}
+
+void SpatialIndex::ResetQueryStats()
+{
+	for (auto& totals : queryTotals)
+		for (auto& total : totals)
+			total.store(0, std::memory_order_relaxed);
+}
+
+// once per query, not per node: the atomics stay out of the traversal
+void SpatialIndex::RecordQuery(SPATIAL_QUERY type, const SpatialQueryCounters& counters) const
+{
+	auto& totals = queryTotals[(int)type];
+	totals[0].fetch_add(1, std::memory_order_relaxed);
+	totals[1].fetch_add(counters.nodesVisited, std::memory_order_relaxed);
+	totals[2].fetch_add(counters.aabbTests, std::memory_order_relaxed);
+	totals[3].fetch_add(counters.objectTests, std::memory_order_relaxed);
+	totals[4].fetch_add(counters.candidates, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------------- [Debug]
+void SpatialIndex::DebugAABB(const math::AABB& aabb)
 {
-	
 	glBegin(GL_LINES);
 	float3 pointsArray[8]; 
-	this->AABB.GetCornerPoints(pointsArray);
+	aabb.GetCornerPoints(pointsArray);
 	
 	// Direct Mode :( -> for the mom, TODO: optimized debug
 	glVertex3f((GLfloat)pointsArray[0].x, (GLfloat)pointsArray[0].y, (GLfloat)pointsArray[0].z);
@@ -270,70 +446,4 @@ void OctreeNode::Debug()
 
 	glEnd();
 	glColor3f(1.0f, 1.0f, 1.0f);
-	
-	
-	// children
-	if (IsLeaf() == false)
-		for (auto& node : childNodes)
-			node->Debug(); 
-		
-}
-
-void OctreeNode::CleanUp()
-{
-	insideObjs.clear(); 
-
-	if (IsLeaf() == true)
-		return; 
-
-	for (auto& childNode : childNodes)
-	{
-		childNode->CleanUp();
-		RELEASE(childNode);
-	}
-}
-
-// debug sutff
-uint SmileSpatialTree::GetInsideCount() const
-{
-	uint ret = root->insideObjs.size(); 
-
-	if (root->IsLeaf())
-		return ret;
-
-	for (auto& child : root->childNodes)
-		child->GetInsideCount(ret); 
-    
-	return ret; 
 }
-
- 
-void OctreeNode::GetInsideCount(uint& ret) 
-{
-	ret += insideObjs.size(); 
-
-	if (IsLeaf())
-		return;
-
-	for (auto& child : childNodes)
-		child->GetInsideCount(ret);
-
-}
-
-uint SmileSpatialTree::GetNodesWithMaxObjects() const
-{
-	uint ret = root->insideObjs.size() >= MAX_NODE_OBJECTS;
-
-	if (root->IsLeaf())
-		return ret;
-
-	for (auto& child : root->childNodes)
-		child->GetIfMaxObjects(ret);
-
-	return ret;
-}
-
-void OctreeNode::GetIfMaxObjects(uint& ret)
-{
-	ret += (insideObjs.size() >= MAX_NODE_OBJECTS);
-}
\ No newline at end of file
@@ -3,130 +3,128 @@
 #include "SmileModule.h"
 #include "ComponentMesh.h"
 #include "ComponentCamera.h"
-#include "MathGeoLib/include/Geometry/AABB.h"
-#include <vector>
-
-static uint MAX_NODE_OBJECTS = 10; 
-static uint MAX_DEPTH = 8; 
-
-class Frustrum;
-// ----------------------------------------------------------------- [OctreeNode]
-class OctreeNode
-{
-public: 
-	OctreeNode(math::AABB aabb) { this->AABB = aabb; }; // for root 
-	OctreeNode(OctreeNode* parentNode, uint i); // for the rest of nodes
-	~OctreeNode(); 
-
-public: 
-	void DeleteObject(GameObject*);
-	void InsertObject(GameObject*);
-	void Debug();
-	void GetInsideCount(uint& ret);
-	void GetIfMaxObjects(uint& ret);
-
-	// Checks a primitive intersects with a quadtree node, then checks the primitive intersects with the objects inside the node
-	template<typename PRIMITIVE>
-	void CollectCandidates(std::vector<GameObject*>& gameObjects, const PRIMITIVE& primitive)
-	{
-		if (primitive.Intersects(AABB))
-		{
-			for (auto& obj : insideObjs)
-				if(primitive.Intersects(obj->GetBoundingData().OBB))
-					gameObjects.push_back(obj);
-				
-			if (IsLeaf() == false)
-			{
-				for (uint i = 0; i < 8; ++i)
-					childNodes[i]->CollectCandidates(gameObjects, primitive);
-			}
-			
-		}
-	}
-
-	// used with frustrum in scene draw 
-	template<typename PRIMITIVE>
-	void CollectCandidatesA(std::vector<GameObject*>& gameObjects, const PRIMITIVE& primitive)
-	{
-		if (primitive.Intersects(AABB))
-		{
-			for (auto& obj : insideObjs)
-			{
-				if (obj->toDraw == false)  // must use a flag so the same obj is not pushed more than once (by other nodes)
-				{
-					gameObjects.push_back(obj); 
-					obj->toDraw = true;
-				}
-			}
-					
-
-			if (IsLeaf() == false)
-			{
-				for (uint i = 0; i < 8; ++i)
-					childNodes[i]->CollectCandidatesA(gameObjects, primitive);
-			}
-
-		}
-	}
-
-
-private: 
-	inline bool IsLeaf() { return childNodes[0] == nullptr; };
-	void Split();
-	bool SendObjectToChildren(GameObject* obj); 
-	void RearrangeObjectsInChildren();
-	void CleanUp(); 
-private: 
-	uint depth = 0; 
-	math::AABB AABB; 
-	std::vector<GameObject*> insideObjs; 
-	OctreeNode* childNodes[8] = { nullptr };
-	OctreeNode* parentNode; 
-
-	friend class SmileSpatialTree; 
-};
-
-// ----------------------------------------------------------------- [Octree]
+#include "SpatialIndex.h"
+#include "Octree.h"
+#include "BVH.h"
+#include "OctreeTuner.h"
+#include "JSONParser.h"
+#include <unordered_map>
+
+#define SPATIAL_BATCH_INSERT 1
+#define SPATIAL_BATCH_MOVE 2
+
+// ----------------------------------------------------------------- [SmileSpatialTree]
+// Keeps the scene's spatial index. The backend (octree or BVH) is chosen in config.json ("SpatialTree") and can be
+// switched at runtime, both serve the same queries
 class SmileSpatialTree : public SmileModule
 {
-public: 
+public:
 	SmileSpatialTree(SmileApp* app, bool start_enabled = true);
 	~SmileSpatialTree();
 
-	void CreateOctree(math::AABB aabb, uint depth = MAX_DEPTH, uint maxNodeObjects = MAX_NODE_OBJECTS);
-	update_status Update(float dt); 
-	bool CleanUp(); 
-	void OnStaticChange(GameObject* obj, bool isStatic); 
-	uint GetNodeCount() const { return nodeCount; };
-	uint GetInsideCount() const;
-	uint GetNodesWithMaxObjects() const;
-	uint GetMaxNodeObjects() const { return MAX_NODE_OBJECTS; };
-	uint GetMaxNodeDepth() const { return MAX_DEPTH; };
+	bool Init();
+	update_status Update(float dt);
+	bool CleanUp();
+
+	void CreateIndex(); // takes the scene's objects. Both backends fit their bounds to them
+	void SetBackend(SPATIAL_BACKEND backend); // rebuilds the index
+	SPATIAL_BACKEND GetBackend() const { return backend; };
+	static const char* GetBackendName(SPATIAL_BACKEND backend) { return (backend == SPATIAL_BACKEND::BVH) ? "BVH" : "Octree"; };
+	Octree* GetOctree() const { return (index && backend == SPATIAL_BACKEND::OCTREE) ? (Octree*)index : nullptr; };
+	BVH* GetBVH() const { return (index && backend == SPATIAL_BACKEND::BVH) ? (BVH*)index : nullptr; };
+
+	void SetOctreeParameters(uint maxDepth, uint maxNodeObjects); // kept for the next octree too
+
+	// Auto-tune: records some frames of queries, replays them in the background on trees built with other parameters,
+	// and adopts the cheapest ones. They go in the scene file
+	void StartAutoTune() { octreeTuner.Start(); };
+	const OctreeTuner& GetTuner() const { return octreeTuner; };
+	void SaveSceneSettings(rapidjson::Writer<rapidjson::StringBuffer>& writer) const;
+	void LoadSceneSettings(const rapidjson::Value& value);
+
+	void OnStaticChange(GameObject* obj, bool isStatic);
+	void OnObjectMoved(GameObject* obj);
+	void RemoveObject(GameObject* obj);
+
+	// Batches: between these, inserts and moves are queued, and applied together (inserts sorted) at the outermost
+	// commit. Batches nest. Removals are applied on the spot, since the object is usually deleted right after: its
+	// queued changes are dropped. Queries made meanwhile do not see the queued changes
+	void BeginBatch() { batchDepth++; };
+	void CommitBatch();
+	bool IsBatching() const { return batchDepth > 0; };
+	bool IndexesDynamicObjects() const { return index && index->IndexesDynamicObjects(); };
+	uint GetNodeCount() const { return (index) ? index->GetNodeCount() : 0; };
+	uint GetInsideCount() const { return (index) ? index->GetInsideCount() : 0; };
+
+	// Stats (tree shape and query counters), to tune the backends' parameters
+	void GetStats(SpatialStats& stats) const;
+	void ResetQueryStats();
+	bool ExportStats(const char* path) const; // JSON
+
+	// Queries are const and keep no state in the index or the objects, so any number of them may run at once
+	// (several cameras, picking, gameplay...) as long as nothing modifies the index meanwhile
 
 	// ultimately checks an obb
 	template<typename PRIMITIVE>
-	void CollectCandidates(std::vector<GameObject*>& gameObjects, const PRIMITIVE& primitive)
+	void CollectCandidates(std::vector<GameObject*>& gameObjects, const PRIMITIVE& primitive) const
 	{
-		root->CollectCandidates(gameObjects, primitive); 
+		if (index)
+			index->CollectCandidates(gameObjects, SpatialPrimitiveQuery<PRIMITIVE>(primitive), true);
 	};
 
 	// ultimately checks an aabb
 	template<typename PRIMITIVE>
-	void CollectCandidatesA(std::vector<GameObject*>& gameObjects, const PRIMITIVE& primitive)
+	void CollectCandidatesA(std::vector<GameObject*>& gameObjects, const PRIMITIVE& primitive) const
+	{
+		if (index)
+			index->CollectCandidates(gameObjects, SpatialPrimitiveQuery<PRIMITIVE>(primitive), false);
+	};
+
+	// Culls against the frustrum itself: the result needs no further tests
+	void CollectFrustrumCandidates(std::vector<GameObject*>& gameObjects, const Frustrum& frustrum) const
+	{
+		octreeTuner.RecordFrustrum(frustrum);
+		if (index)
+			index->CollectFrustrumCandidates(gameObjects, frustrum);
+	};
+
+	// The closest object "test" says the ray hits (see SpatialRayTest). Objects are visited front to back, and only
+	// until the closest hit is nearer than what is left
+	SpatialHit Raycast(const math::LineSegment& ray, const SpatialRayTest& test) const
 	{
-		root->CollectCandidatesA(gameObjects, primitive);
+		octreeTuner.RecordRay(ray);
+		return (index) ? index->Raycast(ray, test) : SpatialHit();
 	};
 
+	// Distance sorted (to the objects' OBB), closest first
+	void CollectNearest(std::vector<SpatialHit>& hits, const float3& point, uint count) const
+	{
+		if (index)
+			index->CollectNearest(hits, point, count, FLOAT_INF);
+	};
 
-private: 
-	void CreateRoot(math::AABB aabb); // for root 
-	void ComputeObjectTree(GameObject* obj);
+	void CollectInRadius(std::vector<SpatialHit>& hits, const float3& point, float radius) const
+	{
+		if (index)
+			index->CollectNearest(hits, point, UINT_MAX, radius);
+	};
 
-private: 
-	uint nodeCount = 0; // debug
-	OctreeNode* root = nullptr; 
- 
-	friend class OctreeNode; 
+private:
+	SpatialIndex* CreateBackend(SPATIAL_BACKEND backend) const;
+	void QueueChange(GameObject* obj, uint change);
+	void DropQueuedChanges(GameObject* obj);
+	void ClearBatch();
+
+private:
+	SPATIAL_BACKEND backend = SPATIAL_BACKEND::OCTREE;
+	SpatialIndex* index = nullptr;
+	float octreeLooseness = DEFAULT_LOOSENESS;
+	uint octreeMaxDepth = DEFAULT_MAX_DEPTH;
+	uint octreeMaxNodeObjects = DEFAULT_MAX_NODE_OBJECTS;
+	mutable OctreeTuner octreeTuner; // records from the (const) queries
+
+	uint batchDepth = 0;
+	std::vector<GameObject*> batchObjects; // the ones with changes queued
+	std::vector<uint> batchChanges; // for each of them (SPATIAL_BATCH_...)
+	std::unordered_map<GameObject*, uint> batchSlots; // object -> its index in the two above
 };
-
-typedef SmileSpatialTree Octree; 
\ No newline at end of file
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "SmileSetup.h"
+#include "MathGeoLib/include/Geometry/AABB.h"
+#include "MathGeoLib/include/Geometry/OBB.h"
+#include "MathGeoLib/include/Geometry/LineSegment.h"
+#include "MathGeoLib/include/Math/MathConstants.h"
+#include <vector>
+#include <queue>
+#include <functional>
+#include <climits>
+#include <atomic>
+#include <cstdint>
+
+#define SPATIAL_NONE UINT_MAX // no node, no child, no handle
+
+class GameObject;
+class Frustrum;
+
+enum class SPATIAL_BACKEND
+{
+	OCTREE,
+	BVH
+};
+
+// ----------------------------------------------------------------- [SpatialQuery]
+// What a backend tests its boxes with. The module wraps any MathGeoLib primitive (ray, frustum...) in one of these,
+// so the CollectCandidates templates do not need to know the backend
+class SpatialQuery
+{
+public:
+	virtual bool Intersects(const math::AABB& box) const = 0;
+	virtual bool Intersects(const math::OBB& box) const = 0;
+};
+
+template<typename PRIMITIVE>
+class SpatialPrimitiveQuery : public SpatialQuery
+{
+public:
+	SpatialPrimitiveQuery(const PRIMITIVE& primitive) : primitive(primitive) {};
+	bool Intersects(const math::AABB& box) const { return primitive.Intersects(box); };
+	bool Intersects(const math::OBB& box) const { return primitive.Intersects(box); };
+
+private:
+	const PRIMITIVE& primitive;
+};
+
+// ----------------------------------------------------------------- [SpatialHit]
+// An object found by a distance query. For rays, the distance is along the segment (0 = a, 1 = b), as MathGeoLib gives it
+struct SpatialHit
+{
+	GameObject* object = nullptr;
+	float distance = FLOAT_INF;
+};
+
+// Tests an object for real (triangles...) once its box is hit: true and the distance along the segment if it is hit too
+typedef std::function<bool(GameObject* obj, float& distance)> SpatialRayTest;
+
+// ----------------------------------------------------------------- [SpatialQueue]
+// Nodes and objects waiting to be visited by a distance query, closest first. A node's distance is a lower bound
+// for everything below it, so a query can stop as soon as the next one is too far
+struct SpatialQueueEntry
+{
+	float distance;
+	uint index; // a node, or an object handle
+	bool isObject;
+
+	bool operator>(const SpatialQueueEntry& other) const { return distance > other.distance; };
+};
+
+typedef std::priority_queue<SpatialQueueEntry, std::vector<SpatialQueueEntry>, std::greater<SpatialQueueEntry>> SpatialQueue;
+
+// ----------------------------------------------------------------- [SpatialStats]
+enum class SPATIAL_QUERY
+{
+	CANDIDATES,
+	FRUSTRUM,
+	RAYCAST,
+	NEAREST,
+	MAX
+};
+
+// One query's work, counted on the stack while it runs and added to the index's totals when it ends
+struct SpatialQueryCounters
+{
+	uint nodesVisited = 0;
+	uint aabbTests = 0; // node bounds tested
+	uint objectTests = 0; // object boxes tested
+	uint candidates = 0; // returned
+};
+
+// Totals since the last reset, for one kind of query
+struct SpatialQueryStats
+{
+	uint64_t queries = 0, nodesVisited = 0, aabbTests = 0, objectTests = 0, candidates = 0;
+};
+
+struct SpatialStats
+{
+	std::vector<uint> nodesPerDepth;
+	std::vector<uint> objectsPerDepth; // object references kept by the nodes at each depth
+	uint nodeCount = 0, leafCount = 0;
+	uint objectCount = 0; // different objects
+	uint referenceCount = 0; // an object kept by several nodes counts once for each
+	float duplicateFactor = 0.f; // references per object
+	float averageLeafObjects = 0.f;
+	uint maxLeafObjects = 0;
+	SpatialQueryStats queries[(int)SPATIAL_QUERY::MAX];
+
+	void AddNode(uint depth, uint objects, bool leaf);
+	void Finish(uint objects); // the averages
+};
+
+// ----------------------------------------------------------------- [SpatialIndex]
+// A spatial index backend. Objects are tracked with GameObject::spatialHandle, owned by the active backend
+class SpatialIndex
+{
+public:
+	virtual ~SpatialIndex() {};
+
+	virtual void Insert(GameObject* obj) = 0; // the object and its children (the ones the index takes)
+	virtual void InsertBatch(const std::vector<GameObject*>& objs) { for (auto& obj : objs) Insert(obj); }; // all at once
+	virtual void Remove(GameObject* obj) = 0;
+	virtual void OnObjectMoved(GameObject* obj) = 0;
+	virtual void Clear() = 0;
+	virtual void Update(float dt) {};
+
+	// "testObjects": also test each object's OBB (otherwise the objects in the nodes hit are all collected)
+	virtual void CollectCandidates(std::vector<GameObject*>& gameObjects, const SpatialQuery& query, bool testObjects) const = 0;
+	virtual void CollectFrustrumCandidates(std::vector<GameObject*>& gameObjects, const Frustrum& frustrum) const = 0;
+	// Front to back: stops once the closest hit so far is nearer than the next node. No object in the result = no hit
+	// The test may run other queries, on this index too, but must not change it (no Insert, Remove or OnObjectMoved)
+	virtual SpatialHit Raycast(const math::LineSegment& ray, const SpatialRayTest& test) const = 0;
+	// Up to "count" objects within "maxDistance" of the point (to their OBB), closest first
+	virtual void CollectNearest(std::vector<SpatialHit>& hits, const float3& point, uint count, float maxDistance) const = 0;
+
+	virtual SPATIAL_BACKEND GetType() const = 0;
+	virtual bool IndexesDynamicObjects() const = 0;
+	virtual uint GetNodeCount() const = 0;
+	virtual uint GetInsideCount() const = 0;
+	virtual void Debug() const = 0;
+
+	// The tree's shape, walked on the spot, and the query counters
+	void GetStats(SpatialStats& stats) const;
+	SpatialQueryStats GetQueryStats(SPATIAL_QUERY type) const;
+	void ResetQueryStats();
+
+protected:
+	static void DebugAABB(const math::AABB& aabb);
+	virtual void GetTreeStats(SpatialStats& stats) const = 0;
+	void RecordQuery(SPATIAL_QUERY type, const SpatialQueryCounters& counters) const; // thread safe, as queries are
+
+private:
+	// [query type][queries, nodes visited, aabb tests, object tests, candidates]
+	mutable std::atomic<uint64_t> queryTotals[(int)SPATIAL_QUERY::MAX][5] = {};
+};